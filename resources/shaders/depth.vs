@@ -0,0 +1,11 @@
+#version 330 core
+// positions only: the depth VAO has no other attributes, vertex pulling reads the position stream only
+#include "uniforms.glsl"
+#include "vertex_input.glsl"
+
+// must match shader.vs exactly, the shading pass tests against this depth
+invariant gl_Position;
+
+void main() {
+    gl_Position = frame.viewProjection * (modelMatrix() * vec4(meshPosition(), 1.0));
+}
@@ -1,10 +1,14 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+// position only stream, see quantize.h
+layout (location = 0) in vec4 aPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "uniforms.glsl"
+
+// position dequantization
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
-}
\ No newline at end of file
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+    gl_Position = frame.viewProjection * (object.model * vec4(position, 1.0));
+}
@@ -1,56 +1,85 @@
 #version 330 core
+// every permutation of the shading pass, see ShaderFeature in shader.h
 out vec4 FragColor;
 
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_specular1;
-uniform sampler2D texture_normal1;
-
-struct Light {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+// material textures are layers of texture arrays, see texture_array.h. samplers of features
+// a permutation doesn't have are left out, meshes without those maps bind nothing to them
+uniform sampler2DArray texture_diffuse1;
+#ifdef SPECULAR_MAP
+uniform sampler2DArray texture_specular1;
+#endif
+#ifdef NORMAL_MAP
+uniform sampler2DArray texture_normal1;
+#endif
 
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoord;
+#if defined(NORMAL_MAP)
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+#elif defined(VERTEX_LIGHTING)
+    vec2 Lighting;              // diffuse and specular factor
+#else
+    vec3 Normal;
+#endif
+    flat vec4 Material;         // diffuse, specular and normal map layer, material index
 } fs_in;
 
-uniform vec3 viewPos;
-uniform Light light;
+#include "uniforms.glsl"
 
-uniform float alpha;
+#ifdef VERTEX_LIGHTING
+// distant draws read coarser mips than their derivatives ask for, detail is lost at that size anyway
+const float MIP_BIAS = 1.0;
+#else
+const float MIP_BIAS = 0.0;
+#endif
 
 void main() {
-    float shininess = 32;
+    Material material = materials[int(fs_in.Material.w)];
+
+    // get diffuse color
+    vec3 color = texture(texture_diffuse1, vec3(fs_in.TexCoord, fs_in.Material.x), MIP_BIAS).rgb * material.diffuse.rgb;
 
-    // obtain normal from normal map in range [0, 1]
-    vec3 normal = texture(texture_normal1, fs_in.TexCoord).rgb;
+#ifdef VERTEX_LIGHTING
+    float occlusion = 1.0;
+    float diff = fs_in.Lighting.x;
+    float spec = fs_in.Lighting.y;
+#else
+#ifdef NORMAL_MAP
+    // obtain normal from normal map in range [0, 1], baked LOD maps carry ambient occlusion in alpha
+    vec4 normalSample = texture(texture_normal1, vec3(fs_in.TexCoord, fs_in.Material.z));
+    vec3 normal = normalSample.rgb;
     // transform normal vector to range [-1, 1]
     normal = normalize(normal * 2.0 - 1.0);     // this normal in tangent space
+    float occlusion = normalSample.a;
+    vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
+    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+#else
+    vec3 normal = normalize(fs_in.Normal);
+    float occlusion = 1.0;
+    vec3 lightDir = normalize(frame.lightPos.xyz - fs_in.FragPos);
+    vec3 viewDir = normalize(frame.viewPos.xyz - fs_in.FragPos);
+#endif
+    float diff = max(dot(lightDir, normal), 0.0);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.specular.w);
+#endif
 
-    // get diffuse color
-    vec3 color = texture(texture_diffuse1, fs_in.TexCoord).rgb;
     // ambient
-    vec3 ambient = light.ambient * color;
-
+    vec3 ambient = frame.lightAmbient.rgb * color * occlusion;
     // diffuse
-    vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
-    float diff = max(dot(lightDir, normal), 0.0);
     vec3 diffuse = diff * color;
-
     // specular
-    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), shininess);
-
-    //vec3 test = texture(texture_normal1, fs_in.TexCoord).rgb;
+    vec3 specular = frame.lightSpecular.rgb * material.specular.rgb * spec;
+#ifdef SPECULAR_MAP
+    specular *= texture(texture_specular1, vec3(fs_in.TexCoord, fs_in.Material.y)).rgb;
+#endif
 
-    vec3 specular = light.specular * spec;
-    FragColor = vec4(ambient + diffuse + specular, alpha);
-    //FragColor = vec4(test, 1.0);
-}
\ No newline at end of file
+#ifdef ALPHA
+    FragColor = vec4(ambient + diffuse + specular, frame.alpha * material.diffuse.a);
+#else
+    FragColor = vec4(ambient + diffuse + specular, 1.0);
+#endif
+}
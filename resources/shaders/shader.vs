@@ -1,41 +1,59 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aTexCoord;
-layout (location = 3) in vec3 aTangent;
+// every permutation of the shading pass, see ShaderFeature in shader.h
+#include "uniforms.glsl"
+#include "vertex_input.glsl"
 
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoord;
+#if defined(NORMAL_MAP)
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+#elif defined(VERTEX_LIGHTING)
+    vec2 Lighting;              // diffuse and specular factor
+#else
+    vec3 Normal;
+#endif
+    flat vec4 Material;         // diffuse, specular and normal map layer, material index
 } vs_out;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+// must match depth.vs exactly for the depth pre-pass
+invariant gl_Position;
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-    vs_out.TexCoord = aTexCoord;
+    vec4 worldPos = modelMatrix() * vec4(meshPosition(), 1.0);
+    vs_out.FragPos = worldPos.xyz;
+    vs_out.TexCoord = vertexTexCoord();
+    vs_out.Material = drawMaterial();
+
+    vec4 q = normalize(vertexQTangent());
+    vec3 N = vec3(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+#if defined(NORMAL_MAP)
+    // rebuild the orthonormal tangent frame from the QTangent
+    vec3 T = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+    vec3 B = vec3(2.0 * (q.x * q.y - q.w * q.z), 1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z + q.w * q.x));
+    B *= q.w < 0.0 ? -1.0 : 1.0;
 
-    // transforms to tangent space
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 N = normalize(normalMatrix * aNormal);
-    T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
-    // TBN matrix for transformation
-    mat3 TBN = transpose(mat3(T, B, N));
+    // TBN matrix for the transformation to tangent space
+    mat3 TBN = transpose(normalMatrix() * mat3(T, B, N));
 
-    vs_out.TangentLightPos = TBN * lightPos;
-    vs_out.TangentViewPos = TBN * viewPos;
+    vs_out.TangentLightPos = TBN * frame.lightPos.xyz;
+    vs_out.TangentViewPos = TBN * frame.viewPos.xyz;
     vs_out.TangentFragPos = TBN * vs_out.FragPos;
+#elif defined(VERTEX_LIGHTING)
+    // lit per vertex for distant draws, the fragments only interpolate the factors
+    vec3 normal = normalize(normalMatrix() * N);
+    vec3 lightDir = normalize(frame.lightPos.xyz - vs_out.FragPos);
+    vec3 viewDir = normalize(frame.viewPos.xyz - vs_out.FragPos);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float shininess = materials[int(vs_out.Material.w)].specular.w;
+    vs_out.Lighting = vec2(max(dot(lightDir, normal), 0.0), pow(max(dot(normal, halfwayDir), 0.0), shininess));
+#else
+    // without a normal map only the normal of the tangent frame is needed, lighting is in world space
+    vs_out.Normal = normalMatrix() * N;
+#endif
 
-    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = frame.viewProjection * worldPos;
+}
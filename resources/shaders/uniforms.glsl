@@ -0,0 +1,29 @@
+// per-frame and per-object data, see uniform_buffer.h
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 viewPos;
+    vec4 lightPos;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+    float alpha;                // opacity of the whole scene, used with ALPHA
+} frame;
+
+#ifndef INSTANCED
+// instanced draws read their transforms from vertex attributes instead
+layout (std140) uniform Object {
+    mat4 model;
+    mat3 normalMatrix;
+} object;
+#endif
+
+// parameters of all materials, see uniform_buffer.h
+struct Material {
+    vec4 diffuse;       // Kd, opacity (d) in w
+    vec4 specular;      // Ks, shininess (Ns) in w
+};
+layout (std140) uniform Materials {
+    Material materials[256];
+};
@@ -0,0 +1,83 @@
+// vertex inputs of all permutations: the compact vertex (see quantize.h) in model space, its
+// transform and the material of the draw. include after uniforms.glsl
+
+#ifdef VERTEX_PULLING
+// no vertex attributes: the vertices are read from the geometry pool by gl_VertexID, which
+// already includes the base vertex of the draw
+layout (std430, binding = 1) readonly buffer PositionStream {
+    uvec2 positions[];      // 4 x unorm16 relative to the mesh bounds, w unused
+};
+layout (std430, binding = 2) readonly buffer AttributeStream {
+    uint attributes[];      // 4 x snorm16 QTangent, 2 x half float texture coords
+};
+
+vec3 vertexPosition() {
+    uvec2 packedPosition = positions[gl_VertexID];
+    return vec3(unpackUnorm2x16(packedPosition.x), unpackUnorm2x16(packedPosition.y).x);
+}
+
+vec4 vertexQTangent() {
+    uint attribute = uint(gl_VertexID) * 3u;
+    return vec4(unpackSnorm2x16(attributes[attribute]), unpackSnorm2x16(attributes[attribute + 1u]));
+}
+
+vec2 vertexTexCoord() {
+    return unpackHalf2x16(attributes[uint(gl_VertexID) * 3u + 2u]);
+}
+#else
+layout (location = 0) in vec4 aPos;         // unorm16 relative to the mesh bounds
+layout (location = 1) in vec4 aQTangent;    // snorm16 quaternion, handedness in the sign of w
+layout (location = 2) in vec2 aTexCoord;    // half float
+
+vec3 vertexPosition() { return aPos.xyz; }
+vec4 vertexQTangent() { return aQTangent; }
+vec2 vertexTexCoord() { return aTexCoord; }
+#endif
+
+#ifdef INSTANCED
+// per-instance transforms, see instance_buffer.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+
+mat4 modelMatrix() { return aModel; }
+mat3 normalMatrix() { return aNormalMatrix; }
+#else
+mat4 modelMatrix() { return object.model; }
+mat3 normalMatrix() { return object.normalMatrix; }
+#endif
+
+#ifdef INDIRECT
+// per-draw data of multi-draw indirect submissions, see indirect_draw.h
+struct DrawData {
+    vec4 positionOffset;
+    vec4 positionScale;
+    uint material;          // index in the Materials block
+    uint diffuseLayer;      // layers in the bound texture arrays, see texture_array.h
+    uint specularLayer;
+    uint normalLayer;
+};
+layout (std430, binding = 0) readonly buffer DrawDataBlock {
+    DrawData draws[];
+};
+// first DrawData of the glMultiDrawElementsIndirect call, gl_DrawID restarts in every call
+uniform int drawOffset;
+
+vec3 meshPosition() {
+    DrawData draw = draws[drawOffset + gl_DrawID];
+    return draw.positionOffset.xyz + vertexPosition() * draw.positionScale.xyz;
+}
+
+vec4 drawMaterial() {
+    DrawData draw = draws[drawOffset + gl_DrawID];
+    return vec4(draw.diffuseLayer, draw.specularLayer, draw.normalLayer, draw.material);
+}
+#else
+// position dequantization
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+// texture array layers of the material (see texture_array.h) and its index in the Materials block
+uniform vec4 material;
+
+vec3 meshPosition() { return positionOffset + vertexPosition() * positionScale; }
+vec4 drawMaterial() { return material; }
+#endif
@@ -0,0 +1,124 @@
+#include "allocation_tracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// static storage is zeroed before any constructor runs, allocations of static initializers count too
+std::atomic<size_t> allocationCount;
+std::atomic<size_t> freeCount;
+std::atomic<size_t> allocatedBytes;
+
+void *allocate(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+
+void release(void *pointer) {
+	if(!pointer)
+		return;
+	freeCount.fetch_add(1, std::memory_order_relaxed);
+	std::free(pointer);
+}
+
+} // namespace
+
+// the replaceable global allocation functions, all other forms forward to these
+void *operator new(size_t size) {
+	void *pointer = allocate(size);
+	if(!pointer)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return allocate(size);
+}
+
+void operator delete(void *pointer) noexcept {
+	release(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+	release(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t&) noexcept {
+	release(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t&) noexcept {
+	release(pointer);
+}
+
+AllocationStats allocationTotals() {
+	AllocationStats stats;
+	stats.allocations = allocationCount.load(std::memory_order_relaxed);
+	stats.frees = freeCount.load(std::memory_order_relaxed);
+	stats.bytes = allocatedBytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+FrameAllocationTracker::FrameAllocationTracker() {
+	phase = -1;
+	frameAllocations = 0;
+	for(int i = 0; i < FRAME_PHASES; i++)
+		lastFrame[i] = 0;
+	ResetStats();
+}
+
+void FrameAllocationTracker::BeginFrame() {
+	frameAllocations = 0;
+	for(int i = 0; i < FRAME_PHASES; i++)
+		lastFrame[i] = 0;
+	BeginPhase(PHASE_UPDATE);
+}
+
+void FrameAllocationTracker::BeginPhase(FramePhase phase) {
+	endPhase();
+	this->phase = phase;
+	phaseStart = allocationTotals();
+}
+
+void FrameAllocationTracker::EndFrame() {
+	endPhase();
+	frames++;
+	if(frameAllocations > 0)
+		allocatingFrames++;
+}
+
+void FrameAllocationTracker::ResetStats() {
+	for(int i = 0; i < FRAME_PHASES; i++)
+		phases[i] = AllocationStats();
+	frames = 0;
+	allocatingFrames = 0;
+}
+
+const char *FrameAllocationTracker::PhaseName(FramePhase phase) {
+	static const char *names[FRAME_PHASES] = { "update", "submit", "draw" };
+	return names[phase];
+}
+
+void FrameAllocationTracker::endPhase() {
+	if(phase < 0)
+		return;
+	AllocationStats now = allocationTotals();
+	AllocationStats &stats = phases[phase];
+	stats.allocations += now.allocations - phaseStart.allocations;
+	stats.frees += now.frees - phaseStart.frees;
+	stats.bytes += now.bytes - phaseStart.bytes;
+	frameAllocations += now.allocations - phaseStart.allocations;
+	lastFrame[phase] += now.allocations - phaseStart.allocations;
+	phase = -1;
+}
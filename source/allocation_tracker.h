@@ -0,0 +1,58 @@
+#ifndef ALLOCATION_TRACKER_H
+#define ALLOCATION_TRACKER_H
+
+#include <stddef.h>
+
+struct AllocationStats {
+	size_t allocations = 0;
+	size_t frees = 0;
+	size_t bytes = 0;	// allocated, frees don't know their size
+};
+
+// everything that went through the global operator new/delete since the program started
+AllocationStats allocationTotals();
+
+// parts of a frame the allocations are attributed to
+enum FramePhase {
+	PHASE_UPDATE,	// input, per-frame uniforms
+	PHASE_SUBMIT,	// culling, queue and indirect command building
+	PHASE_DRAW,		// executing the draws
+	FRAME_PHASES
+};
+
+/*
+heap allocations of the render loop per frame and phase. a steady frame allocates nothing:
+all containers it fills keep their capacity from earlier frames. allocations in every frame of
+a period mean something allocates again (strings built for uniform names, temporaries...)
+*/
+class FrameAllocationTracker {
+public:
+	FrameAllocationTracker();
+	void BeginFrame();
+	// ends the phase before
+	void BeginPhase(FramePhase phase);
+	void EndFrame();
+
+	// summed over the frames since ResetStats
+	const AllocationStats &Phase(FramePhase phase) const { return phases[phase]; }
+	size_t Frames() const { return frames; }
+	size_t AllocatingFrames() const { return allocatingFrames; }
+	// allocations of a phase in the last ended frame
+	size_t LastFrame(FramePhase phase) const { return lastFrame[phase]; }
+	void ResetStats();
+
+	static const char *PhaseName(FramePhase phase);
+
+private:
+	AllocationStats phases[FRAME_PHASES];
+	AllocationStats phaseStart;
+	int phase;
+	size_t frameAllocations;
+	size_t lastFrame[FRAME_PHASES];
+	size_t frames;
+	size_t allocatingFrames;
+
+	void endPhase();
+};
+
+#endif // ALLOCATION_TRACKER_H
@@ -0,0 +1,115 @@
+#include "frustum.h"
+
+#include <cmath>
+
+// FRUSTUM_NO_SSE2 forces the scalar path, tests/frustum_test.cpp builds both
+#if !defined(FRUSTUM_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FRUSTUM_SSE2
+#include <emmintrin.h>
+#endif
+
+Frustum extractFrustum(const glm::mat4 &matrix) {
+	// Gribb/Hartmann: the planes are sums and differences of the matrix rows (glm is column major)
+	glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+	glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+	glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+	glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;	// left
+	frustum.planes[1] = row3 - row0;	// right
+	frustum.planes[2] = row3 + row1;	// bottom
+	frustum.planes[3] = row3 - row1;	// top
+	frustum.planes[4] = row3 + row2;	// near
+	frustum.planes[5] = row3 - row2;	// far
+	// normalize so plane distances are in world units
+	for(int i = 0; i < 6; i++)
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+	for(int i = 0; i < 8; i++) {
+		// padding: normal 0 and a huge distance, every box and sphere is inside
+		glm::vec4 plane = i < 6 ? frustum.planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1e30f);
+		for(int c = 0; c < 4; c++)
+			frustum.lanes[c][i] = plane[c];
+	}
+	return frustum;
+}
+
+/*
+a box is outside of a plane if the corner furthest along the normal is behind it:
+dot(n, center) + w + dot(|n|, extent) < 0. a sphere is the same test with extent 0 and the
+radius added. with SSE2 four planes are tested per instruction, two batches cover all six.
+the scalar paths go over the same eight lanes in the same order of operations, so both give
+the same result for bounds touching a plane
+*/
+static bool boundsInFrustum(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent, float radius) {
+#ifdef FRUSTUM_SSE2
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+	__m128 r = _mm_set1_ps(radius);
+	__m128 outside = _mm_setzero_ps();
+	for(int i = 0; i < 8; i += 4) {
+		__m128 nx = _mm_loadu_ps(&frustum.lanes[0][i]);
+		__m128 ny = _mm_loadu_ps(&frustum.lanes[1][i]);
+		__m128 nz = _mm_loadu_ps(&frustum.lanes[2][i]);
+		__m128 w = _mm_loadu_ps(&frustum.lanes[3][i]);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+									 _mm_add_ps(_mm_mul_ps(nz, cz), w));
+		// dot(|n|, extent): clearing the sign bits gives the absolute values
+		__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+											 _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+								  _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nz), ez), r));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+	}
+	return _mm_movemask_ps(outside) == 0;
+#else
+	for(int i = 0; i < 8; i++) {
+		const float nx = frustum.lanes[0][i], ny = frustum.lanes[1][i], nz = frustum.lanes[2][i];
+		float distance = (nx * center.x + ny * center.y) + (nz * center.z + frustum.lanes[3][i]);
+		float reach = (std::fabs(nx) * extent.x + std::fabs(ny) * extent.y) + (std::fabs(nz) * extent.z + radius);
+		if(distance + reach < 0.0f)
+			return false;
+	}
+	return true;
+#endif
+}
+
+FrustumOverlap sphereFrustumOverlap(const Frustum &frustum, const glm::vec3 &center, float radius) {
+	// outside if behind any plane by more than the radius, inside if in front of all by at least the radius
+#ifdef FRUSTUM_SSE2
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 r = _mm_set1_ps(radius), negativeR = _mm_set1_ps(-radius);
+	__m128 outside = _mm_setzero_ps(), crossing = _mm_setzero_ps();
+	for(int i = 0; i < 8; i += 4) {
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&frustum.lanes[0][i]), cx),
+												_mm_mul_ps(_mm_loadu_ps(&frustum.lanes[1][i]), cy)),
+									 _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&frustum.lanes[2][i]), cz),
+												_mm_loadu_ps(&frustum.lanes[3][i])));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeR));
+		crossing = _mm_or_ps(crossing, _mm_cmplt_ps(distance, r));
+	}
+	if(_mm_movemask_ps(outside))
+		return FRUSTUM_OUTSIDE;
+	return _mm_movemask_ps(crossing) ? FRUSTUM_INTERSECTING : FRUSTUM_INSIDE;
+#else
+	FrustumOverlap overlap = FRUSTUM_INSIDE;
+	for(int i = 0; i < 8; i++) {
+		float distance = (frustum.lanes[0][i] * center.x + frustum.lanes[1][i] * center.y) +
+						 (frustum.lanes[2][i] * center.z + frustum.lanes[3][i]);
+		if(distance < -radius)
+			return FRUSTUM_OUTSIDE;
+		if(distance < radius)
+			overlap = FRUSTUM_INTERSECTING;
+	}
+	return overlap;
+#endif
+}
+
+bool sphereInFrustum(const Frustum &frustum, const glm::vec3 &center, float radius) {
+	return boundsInFrustum(frustum, center, glm::vec3(0.0f), radius);
+}
+
+bool boxInFrustum(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent) {
+	return boundsInFrustum(frustum, center, extent, 0.0f);
+}
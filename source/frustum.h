@@ -0,0 +1,28 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// view frustum as six inward facing planes (xyz: normal, w: distance), in the space
+// of the matrix it was extracted from (e.g. model space for projection * view * model)
+struct Frustum {
+	glm::vec4 planes[6];
+	// the planes transposed for testing four at a time: x, y, z and w of planes 0-3, then of
+	// planes 4-5 and two padding planes everything is far inside of
+	float lanes[4][8];
+};
+
+enum FrustumOverlap {
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INSIDE,
+	FRUSTUM_INTERSECTING	// crosses at least one plane, a tighter volume may still be outside
+};
+
+Frustum extractFrustum(const glm::mat4 &matrix);
+// one pass over the planes, classifies the sphere as outside, fully inside or crossing a plane
+FrustumOverlap sphereFrustumOverlap(const Frustum &frustum, const glm::vec3 &center, float radius);
+bool sphereInFrustum(const Frustum &frustum, const glm::vec3 &center, float radius);
+// false if the axis aligned box (center, half extent) is entirely outside one of the planes
+bool boxInFrustum(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent);
+
+#endif // FRUSTUM_H
@@ -0,0 +1,351 @@
+#include "geometry_pool.h"
+#include "gl_state.h"
+
+#include <algorithm>
+
+namespace {
+
+const size_t INITIAL_VERTEX_CAPACITY = 1 << 18;
+const size_t INITIAL_INDEX_CAPACITY = 1 << 22;	// bytes
+// index ranges start 4 byte aligned, whatever their index type
+const size_t INDEX_ALIGNMENT = 4;
+
+unsigned int createBuffer(size_t bytes) {
+	unsigned int buffer;
+	glGenBuffers(1, &buffer);
+	glState().BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+	return buffer;
+}
+
+void copyBuffer(unsigned int source, unsigned int destination, size_t sourceOffset, size_t destinationOffset,
+				size_t bytes) {
+	glState().BindBuffer(GL_COPY_READ_BUFFER, source);
+	glState().BindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, destinationOffset, bytes);
+}
+
+void upload(unsigned int buffer, size_t offset, size_t bytes, const void *data) {
+	glState().BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+}
+
+float fragmentation(const RangeAllocator &allocator, size_t largestFree) {
+	size_t free = allocator.Capacity() - allocator.Used();
+	return free > 0 ? 1.0f - (float)largestFree / free : 0.0f;
+}
+
+} // namespace
+
+RangeAllocator::RangeAllocator(size_t capacity) {
+	this->capacity = 0;
+	used = 0;
+	Grow(capacity);
+}
+
+bool RangeAllocator::Allocate(size_t size, size_t alignment, size_t &offset) {
+	// best fit, counting the padding needed for the alignment
+	std::map<size_t, size_t>::iterator best = freeBlocks.end();
+	size_t bestWaste = ~(size_t)0;
+	for(std::map<size_t, size_t>::iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+		size_t padding = (alignment - it->first % alignment) % alignment;
+		if(it->second < size + padding)
+			continue;
+		size_t waste = it->second - size;
+		if(waste < bestWaste) {
+			best = it;
+			bestWaste = waste;
+		}
+	}
+	if(best == freeBlocks.end())
+		return false;
+
+	size_t blockOffset = best->first;
+	size_t blockSize = best->second;
+	size_t padding = (alignment - blockOffset % alignment) % alignment;
+	freeBlocks.erase(best);
+	// the padding in front and the rest behind stay free
+	if(padding > 0)
+		freeBlocks[blockOffset] = padding;
+	if(blockSize > padding + size)
+		freeBlocks[blockOffset + padding + size] = blockSize - padding - size;
+	offset = blockOffset + padding;
+	used += size;
+	return true;
+}
+
+void RangeAllocator::Free(size_t offset, size_t size) {
+	used -= size;
+	std::map<size_t, size_t>::iterator next = freeBlocks.lower_bound(offset);
+	// merge with the following block
+	if(next != freeBlocks.end() && offset + size == next->first) {
+		size += next->second;
+		next = freeBlocks.erase(next);
+	}
+	// merge with the preceding block
+	if(next != freeBlocks.begin()) {
+		std::map<size_t, size_t>::iterator previous = next;
+		--previous;
+		if(previous->first + previous->second == offset) {
+			previous->second += size;
+			return;
+		}
+	}
+	freeBlocks[offset] = size;
+}
+
+void RangeAllocator::Grow(size_t capacity) {
+	if(capacity <= this->capacity)
+		return;
+	size_t oldCapacity = this->capacity;
+	size_t added = capacity - oldCapacity;
+	this->capacity = capacity;
+	// adding the new space as allocated and freeing it merges it with a free block at the end
+	used += added;
+	Free(oldCapacity, added);
+}
+
+void RangeAllocator::Reset(size_t used) {
+	freeBlocks.clear();
+	this->used = used;
+	if(capacity > used)
+		freeBlocks[used] = capacity - used;
+}
+
+size_t RangeAllocator::LargestFreeBlock() const {
+	size_t largest = 0;
+	for(std::map<size_t, size_t>::const_iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+		largest = std::max(largest, it->second);
+	return largest;
+}
+
+GeometryPool::GeometryPool() : vertexAllocator(INITIAL_VERTEX_CAPACITY), indexAllocator(INITIAL_INDEX_CAPACITY) {
+	glGenVertexArrays(1, &VAO);
+	glGenVertexArrays(1, &depthVAO);
+	glGenVertexArrays(1, &instancedVAO);
+	glGenVertexArrays(1, &pullingVAO);
+	positionVBO = createBuffer(INITIAL_VERTEX_CAPACITY * sizeof(PackedPosition));
+	attributeVBO = createBuffer(INITIAL_VERTEX_CAPACITY * sizeof(PackedAttributes));
+	EBO = createBuffer(INITIAL_INDEX_CAPACITY);
+	setupVertexArrays();
+}
+
+void GeometryPool::setupVertexArrays() {
+	// the format of the packed vertices, see quantize.h. the instanced VAO adds per-instance
+	// attributes, those are pointed at an instance buffer in BindInstanced
+	unsigned int fullVAOs[2] = { VAO, instancedVAO };
+	for(int i = 0; i < 2; i++) {
+		glState().BindVertexArray(fullVAOs[i]);
+		glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		// vertex positions (unorm16)
+		glState().BindBuffer(GL_ARRAY_BUFFER, positionVBO);
+		glEnableVertexAttribArray(0);	// location 0
+		glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedPosition), (void*)0);
+		// vertex tangent frames (snorm16 quaternion)
+		glState().BindBuffer(GL_ARRAY_BUFFER, attributeVBO);
+		glEnableVertexAttribArray(1);	// location 1
+		glVertexAttribPointer(1, 4, GL_SHORT, GL_TRUE, sizeof(PackedAttributes),
+							  (void*)offsetof(PackedAttributes, QTangent));
+		// vertex texture coords (half float)
+		glEnableVertexAttribArray(2);	// location 2
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedAttributes),
+							  (void*)offsetof(PackedAttributes, TexCoord));
+	}
+	instanceBuffer = 0;
+	instanceOffset = 0;
+
+	// position only VAO, sharing the index buffer
+	glState().BindVertexArray(depthVAO);
+	glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glState().BindBuffer(GL_ARRAY_BUFFER, positionVBO);
+	glEnableVertexAttribArray(0);	// location 0
+	glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedPosition), (void*)0);
+
+	glState().BindVertexArray(pullingVAO);
+	glState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	glState().BindVertexArray(0);
+}
+
+unsigned int GeometryPool::addAllocation(size_t offset, size_t size, bool vertices) {
+	Allocation allocation;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.vertices = vertices;
+	allocation.live = true;
+	if(!freeHandles.empty()) {
+		unsigned int handle = freeHandles.back();
+		freeHandles.pop_back();
+		allocations[handle] = allocation;
+		return handle;
+	}
+	allocations.push_back(allocation);
+	return allocations.size() - 1;
+}
+
+unsigned int GeometryPool::AllocateVertices(const std::vector<PackedPosition> &positions,
+											const std::vector<PackedAttributes> &attributes) {
+	size_t count = positions.size();
+	size_t offset;
+	if(!vertexAllocator.Allocate(count, 1, offset)) {
+		growVertices(std::max(vertexAllocator.Capacity() * 2, vertexAllocator.Capacity() + count));
+		vertexAllocator.Allocate(count, 1, offset);
+	}
+	if(count > 0) {
+		upload(positionVBO, offset * sizeof(PackedPosition), count * sizeof(PackedPosition), &positions[0]);
+		upload(attributeVBO, offset * sizeof(PackedAttributes), count * sizeof(PackedAttributes), &attributes[0]);
+	}
+	return addAllocation(offset, count, true);
+}
+
+unsigned int GeometryPool::AllocateIndices(const void *data, size_t bytes) {
+	size_t offset;
+	if(!indexAllocator.Allocate(bytes, INDEX_ALIGNMENT, offset)) {
+		growIndices(std::max(indexAllocator.Capacity() * 2, indexAllocator.Capacity() + bytes + INDEX_ALIGNMENT));
+		indexAllocator.Allocate(bytes, INDEX_ALIGNMENT, offset);
+	}
+	if(bytes > 0)
+		upload(EBO, offset, bytes, data);
+	return addAllocation(offset, bytes, false);
+}
+
+void GeometryPool::Free(unsigned int handle) {
+	Allocation &allocation = allocations[handle];
+	if(!allocation.live)
+		return;
+	if(allocation.vertices)
+		vertexAllocator.Free(allocation.offset, allocation.size);
+	else
+		indexAllocator.Free(allocation.offset, allocation.size);
+	allocation.live = false;
+	freeHandles.push_back(handle);
+}
+
+void GeometryPool::growVertices(size_t capacity) {
+	// copy into larger buffers, the vertex offsets stay the same
+	size_t oldCapacity = vertexAllocator.Capacity();
+	unsigned int positions = createBuffer(capacity * sizeof(PackedPosition));
+	unsigned int attributes = createBuffer(capacity * sizeof(PackedAttributes));
+	copyBuffer(positionVBO, positions, 0, 0, oldCapacity * sizeof(PackedPosition));
+	copyBuffer(attributeVBO, attributes, 0, 0, oldCapacity * sizeof(PackedAttributes));
+	glState().DeleteBuffer(positionVBO);
+	glState().DeleteBuffer(attributeVBO);
+	positionVBO = positions;
+	attributeVBO = attributes;
+	vertexAllocator.Grow(capacity);
+	setupVertexArrays();
+}
+
+void GeometryPool::growIndices(size_t capacity) {
+	unsigned int indices = createBuffer(capacity);
+	copyBuffer(EBO, indices, 0, 0, indexAllocator.Capacity());
+	glState().DeleteBuffer(EBO);
+	EBO = indices;
+	indexAllocator.Grow(capacity);
+	setupVertexArrays();
+}
+
+void GeometryPool::Defragment() {
+	// live allocations in buffer order, so packing them keeps their relative order
+	std::vector<unsigned int> order;
+	for(unsigned int i = 0; i < allocations.size(); i++) {
+		if(allocations[i].live)
+			order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+		return allocations[a].offset < allocations[b].offset;
+	});
+
+	// copies go to fresh buffers, ranges within one buffer must not overlap
+	unsigned int positions = createBuffer(vertexAllocator.Capacity() * sizeof(PackedPosition));
+	unsigned int attributes = createBuffer(vertexAllocator.Capacity() * sizeof(PackedAttributes));
+	unsigned int indices = createBuffer(indexAllocator.Capacity());
+	size_t vertexEnd = 0, indexEnd = 0;
+	// alignment padding in front of index ranges (offset -> size), it stays free
+	std::vector<std::pair<size_t, size_t> > indexPadding;
+	for(unsigned int i = 0; i < order.size(); i++) {
+		Allocation &allocation = allocations[order[i]];
+		if(allocation.vertices) {
+			if(allocation.size > 0) {
+				copyBuffer(positionVBO, positions, allocation.offset * sizeof(PackedPosition),
+						   vertexEnd * sizeof(PackedPosition), allocation.size * sizeof(PackedPosition));
+				copyBuffer(attributeVBO, attributes, allocation.offset * sizeof(PackedAttributes),
+						   vertexEnd * sizeof(PackedAttributes), allocation.size * sizeof(PackedAttributes));
+			}
+			allocation.offset = vertexEnd;
+			vertexEnd += allocation.size;
+		}
+		else {
+			size_t aligned = (indexEnd + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+			if(aligned > indexEnd)
+				indexPadding.push_back(std::make_pair(indexEnd, aligned - indexEnd));
+			indexEnd = aligned;
+			if(allocation.size > 0)
+				copyBuffer(EBO, indices, allocation.offset, indexEnd, allocation.size);
+			allocation.offset = indexEnd;
+			indexEnd += allocation.size;
+		}
+	}
+	glState().DeleteBuffer(positionVBO);
+	glState().DeleteBuffer(attributeVBO);
+	glState().DeleteBuffer(EBO);
+	positionVBO = positions;
+	attributeVBO = attributes;
+	EBO = indices;
+
+	vertexAllocator.Reset(vertexEnd);
+	// used counts the surviving ranges only, freeing the padding keeps it out of used
+	indexAllocator.Reset(indexEnd);
+	for(unsigned int i = 0; i < indexPadding.size(); i++)
+		indexAllocator.Free(indexPadding[i].first, indexPadding[i].second);
+	setupVertexArrays();
+}
+
+void GeometryPool::Bind(bool positionsOnly) {
+	glState().BindVertexArray(positionsOnly ? depthVAO : VAO);
+}
+
+void GeometryPool::BindStreams(bool positionsOnly) {
+	glState().BindVertexArray(pullingVAO);
+	glState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, POSITION_STREAM_BINDING, positionVBO);
+	if(!positionsOnly)
+		glState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, ATTRIBUTE_STREAM_BINDING, attributeVBO);
+}
+
+void GeometryPool::BindInstanced(const InstanceBuffer &instances) {
+	glState().BindVertexArray(instancedVAO);
+	if(instanceBuffer == instances.ID() && instanceOffset == instances.Offset())
+		return;
+	// model matrix (4 columns) and normal matrix (3 columns), advancing once per instance
+	glState().BindBuffer(GL_ARRAY_BUFFER, instances.ID());
+	for(unsigned int i = 0; i < 7; i++) {
+		unsigned int location = INSTANCE_ATTRIBUTE_LOCATION + i;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, i < 4 ? 4 : 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+							  (void*)(instances.Offset() + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	instanceBuffer = instances.ID();
+	instanceOffset = instances.Offset();
+}
+
+void GeometryPool::Unbind() {
+	glState().BindVertexArray(0);
+}
+
+GeometryPoolStats GeometryPool::Stats() const {
+	GeometryPoolStats stats;
+	stats.vertexCapacity = vertexAllocator.Capacity();
+	stats.verticesUsed = vertexAllocator.Used();
+	stats.indexCapacity = indexAllocator.Capacity();
+	stats.indexBytesUsed = indexAllocator.Used();
+	stats.freeBlocks = vertexAllocator.FreeBlockCount() + indexAllocator.FreeBlockCount();
+	stats.vertexFragmentation = fragmentation(vertexAllocator, vertexAllocator.LargestFreeBlock());
+	stats.indexFragmentation = fragmentation(indexAllocator, indexAllocator.LargestFreeBlock());
+	return stats;
+}
+
+GeometryPool &geometryPool() {
+	static GeometryPool pool;
+	return pool;
+}
@@ -0,0 +1,106 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/glad.h>
+
+#include "quantize.h"
+#include "instance_buffer.h"
+#include "indirect_draw.h"
+
+#include <map>
+#include <vector>
+
+// free list sub-allocator over a range of units (vertices or bytes). allocations take the
+// smallest free block that fits (best fit), freed blocks merge with their free neighbours
+class RangeAllocator {
+public:
+	RangeAllocator(size_t capacity = 0);
+	// false if no free block is large enough
+	bool Allocate(size_t size, size_t alignment, size_t &offset);
+	void Free(size_t offset, size_t size);
+	// extends the range at its end
+	void Grow(size_t capacity);
+	// forgets all blocks, the first used units are allocated and the rest is free
+	void Reset(size_t used);
+
+	size_t Capacity() const { return capacity; }
+	size_t Used() const { return used; }
+	size_t FreeBlockCount() const { return freeBlocks.size(); }
+	size_t LargestFreeBlock() const;
+
+private:
+	size_t capacity;
+	size_t used;
+	// offset -> size
+	std::map<size_t, size_t> freeBlocks;
+};
+
+struct GeometryPoolStats {
+	size_t vertexCapacity;
+	size_t verticesUsed;
+	size_t indexCapacity;	// bytes
+	size_t indexBytesUsed;
+	size_t freeBlocks;
+	// share of the free space that is not part of the largest free block (0: one contiguous hole)
+	float vertexFragmentation;
+	float indexFragmentation;
+};
+
+/*
+all mesh geometry in a few large buffers: a position and an attribute stream (indexed by the
+same vertex offset) and one index buffer. meshes hold handles to ranges of these, draw with
+glDrawElementsBaseVertex and share one VAO per vertex format (full and position only).
+offsets change on growth and defragmentation, so they are looked up through the handle at draw time
+*/
+class GeometryPool {
+public:
+	GeometryPool();
+
+	unsigned int AllocateVertices(const std::vector<PackedPosition> &positions,
+								  const std::vector<PackedAttributes> &attributes);
+	unsigned int AllocateIndices(const void *data, size_t bytes);
+	void Free(unsigned int handle);
+	// vertex offset (base vertex) or byte offset into the index buffer
+	size_t Offset(unsigned int handle) const { return allocations[handle].offset; }
+
+	// moves all live ranges to the front of their buffers, leaving one free block at the end besides the
+	// alignment padding between index ranges
+	void Defragment();
+	// binds the shared VAO (redundant binds are filtered by the GL state cache)
+	void Bind(bool positionsOnly);
+	// binds the vertex streams as storage buffers for vertex pulling and a VAO without attributes
+	void BindStreams(bool positionsOnly);
+	// binds the VAO with per-instance attributes read from instances
+	void BindInstanced(const InstanceBuffer &instances);
+	void Unbind();
+	GeometryPoolStats Stats() const;
+
+private:
+	struct Allocation {
+		size_t offset;
+		size_t size;
+		bool vertices;
+		bool live;
+	};
+	std::vector<Allocation> allocations;
+	std::vector<unsigned int> freeHandles;
+	RangeAllocator vertexAllocator, indexAllocator;
+
+	unsigned int VAO, depthVAO, instancedVAO;
+	// index buffer only, the vertex shader fetches the vertices itself
+	unsigned int pullingVAO;
+	// instance buffer (and offset into it) the per-instance attributes of instancedVAO point to
+	unsigned int instanceBuffer;
+	size_t instanceOffset;
+	unsigned int positionVBO, attributeVBO, EBO;
+
+	unsigned int addAllocation(size_t offset, size_t size, bool vertices);
+	void growVertices(size_t capacity);
+	void growIndices(size_t capacity);
+	void setupVertexArrays();
+};
+
+// the pool shared by all meshes, created on first use (needs a current GL context)
+GeometryPool &geometryPool();
+
+#endif // GEOMETRY_POOL_H
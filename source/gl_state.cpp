@@ -0,0 +1,220 @@
+#include "gl_state.h"
+
+// initial values are the GL defaults of a new context
+GLState::GLState() {
+	program = 0;
+	vao = 0;
+	for(int i = 0; i < BUFFER_TARGETS; i++)
+		buffers[i] = 0;
+	for(unsigned int i = 0; i < MAX_BUFFER_BINDINGS; i++) {
+		uniformBindings[i].buffer = storageBindings[i].buffer = 0;
+		uniformBindings[i].offset = storageBindings[i].offset = 0;
+		uniformBindings[i].size = storageBindings[i].size = 0;
+	}
+	activeUnit = 0;
+	for(unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+		textures[i].target = GL_TEXTURE_2D;
+		textures[i].texture = 0;
+	}
+	for(int i = 0; i < CAPABILITIES; i++)
+		capabilities[i] = false;
+	blendSource = GL_ONE;
+	blendDestination = GL_ZERO;
+	depthFunction = GL_LESS;
+	depthWrite = true;
+	colorWrite = true;
+}
+
+bool GLState::changed(bool different) {
+	if(different)
+		stats.issued++;
+	else
+		stats.filtered++;
+	return different;
+}
+
+int GLState::bufferTarget(GLenum target) {
+	switch(target) {
+		case GL_ARRAY_BUFFER: return ARRAY;
+		case GL_UNIFORM_BUFFER: return UNIFORM;
+		case GL_COPY_READ_BUFFER: return COPY_READ;
+		case GL_COPY_WRITE_BUFFER: return COPY_WRITE;
+		case GL_SHADER_STORAGE_BUFFER: return SHADER_STORAGE;
+		case GL_DRAW_INDIRECT_BUFFER: return DRAW_INDIRECT;
+		default: return -1;
+	}
+}
+
+int GLState::capability(GLenum capability) {
+	switch(capability) {
+		case GL_BLEND: return BLEND;
+		case GL_DEPTH_TEST: return DEPTH_TEST;
+		case GL_CULL_FACE: return CULL_FACE;
+		default: return -1;
+	}
+}
+
+GLState::IndexedBinding *GLState::indexedBinding(GLenum target, unsigned int index) {
+	if(index >= MAX_BUFFER_BINDINGS)
+		return NULL;
+	if(target == GL_UNIFORM_BUFFER)
+		return &uniformBindings[index];
+	if(target == GL_SHADER_STORAGE_BUFFER)
+		return &storageBindings[index];
+	return NULL;
+}
+
+void GLState::UseProgram(unsigned int program) {
+	if(changed(program != this->program)) {
+		glUseProgram(program);
+		this->program = program;
+	}
+}
+
+void GLState::BindVertexArray(unsigned int vao) {
+	if(changed(vao != this->vao)) {
+		glBindVertexArray(vao);
+		this->vao = vao;
+	}
+}
+
+void GLState::BindBuffer(GLenum target, unsigned int buffer) {
+	int index = bufferTarget(target);
+	if(index < 0) {
+		stats.issued++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if(changed(buffers[index] != buffer)) {
+		glBindBuffer(target, buffer);
+		buffers[index] = buffer;
+	}
+}
+
+void GLState::BindBufferBase(GLenum target, unsigned int index, unsigned int buffer) {
+	IndexedBinding *binding = indexedBinding(target, index);
+	if(!binding)
+		stats.issued++;
+	else if(!changed(binding->buffer != buffer || binding->size != 0))
+		return;
+	glBindBufferBase(target, index, buffer);
+	if(binding) {
+		binding->buffer = buffer;
+		binding->offset = 0;
+		binding->size = 0;
+	}
+	// also binds the generic binding point
+	int generic = bufferTarget(target);
+	if(generic >= 0)
+		buffers[generic] = buffer;
+}
+
+void GLState::BindBufferRange(GLenum target, unsigned int index, unsigned int buffer, size_t offset, size_t size) {
+	IndexedBinding *binding = indexedBinding(target, index);
+	if(!binding)
+		stats.issued++;
+	else if(!changed(binding->buffer != buffer || binding->offset != offset || binding->size != size))
+		return;
+	glBindBufferRange(target, index, buffer, offset, size);
+	if(binding) {
+		binding->buffer = buffer;
+		binding->offset = offset;
+		binding->size = size;
+	}
+	int generic = bufferTarget(target);
+	if(generic >= 0)
+		buffers[generic] = buffer;
+}
+
+void GLState::DeleteBuffer(unsigned int buffer) {
+	glDeleteBuffers(1, &buffer);
+	for(int i = 0; i < BUFFER_TARGETS; i++) {
+		if(buffers[i] == buffer)
+			buffers[i] = 0;
+	}
+	for(unsigned int i = 0; i < MAX_BUFFER_BINDINGS; i++) {
+		if(uniformBindings[i].buffer == buffer)
+			uniformBindings[i].buffer = 0;
+		if(storageBindings[i].buffer == buffer)
+			storageBindings[i].buffer = 0;
+	}
+}
+
+void GLState::BindTexture(unsigned int unit, GLenum target, unsigned int texture) {
+	// only the last bound target of a unit is known, other targets are always rebound
+	if(unit < MAX_TEXTURE_UNITS && !changed(textures[unit].target != target || textures[unit].texture != texture))
+		return;
+	if(changed(unit != activeUnit)) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+	}
+	glBindTexture(target, texture);
+	if(unit < MAX_TEXTURE_UNITS) {
+		textures[unit].target = target;
+		textures[unit].texture = texture;
+	}
+	else {
+		stats.issued++;
+	}
+}
+
+void GLState::Enable(GLenum capability) {
+	int index = GLState::capability(capability);
+	if(index < 0) {
+		stats.issued++;
+		glEnable(capability);
+		return;
+	}
+	if(changed(!capabilities[index])) {
+		glEnable(capability);
+		capabilities[index] = true;
+	}
+}
+
+void GLState::Disable(GLenum capability) {
+	int index = GLState::capability(capability);
+	if(index < 0) {
+		stats.issued++;
+		glDisable(capability);
+		return;
+	}
+	if(changed(capabilities[index])) {
+		glDisable(capability);
+		capabilities[index] = false;
+	}
+}
+
+void GLState::BlendFunc(GLenum source, GLenum destination) {
+	if(changed(source != blendSource || destination != blendDestination)) {
+		glBlendFunc(source, destination);
+		blendSource = source;
+		blendDestination = destination;
+	}
+}
+
+void GLState::DepthFunc(GLenum function) {
+	if(changed(function != depthFunction)) {
+		glDepthFunc(function);
+		depthFunction = function;
+	}
+}
+
+void GLState::DepthMask(bool write) {
+	if(changed(write != depthWrite)) {
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+		depthWrite = write;
+	}
+}
+
+void GLState::ColorMask(bool write) {
+	if(changed(write != colorWrite)) {
+		GLboolean mask = write ? GL_TRUE : GL_FALSE;
+		glColorMask(mask, mask, mask, mask);
+		colorWrite = write;
+	}
+}
+
+GLState &glState() {
+	static GLState state;
+	return state;
+}
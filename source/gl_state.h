@@ -0,0 +1,85 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+
+struct GLStateStats {
+	// state calls passed on to GL
+	size_t issued = 0;
+	// calls skipped because they would not change anything
+	size_t filtered = 0;
+};
+
+/*
+shadow copy of the GL state the renderer changes: calls that set what is already set are dropped.
+all binds of the tracked state have to go through here, otherwise the shadow copy goes stale.
+element array buffer binds belong to the bound VAO and are always issued
+*/
+class GLState {
+public:
+	GLState();
+
+	void UseProgram(unsigned int program);
+	void BindVertexArray(unsigned int vao);
+	void BindBuffer(GLenum target, unsigned int buffer);
+	void BindBufferBase(GLenum target, unsigned int index, unsigned int buffer);
+	void BindBufferRange(GLenum target, unsigned int index, unsigned int buffer, size_t offset, size_t size);
+	// deleting a bound object binds 0 in its place
+	void DeleteBuffer(unsigned int buffer);
+	void BindTexture(unsigned int unit, GLenum target, unsigned int texture);
+
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void BlendFunc(GLenum source, GLenum destination);
+	void DepthFunc(GLenum function);
+	void DepthMask(bool write);
+	void ColorMask(bool write);
+
+	unsigned int Program() const { return program; }
+	const GLStateStats &Stats() const { return stats; }
+	void ResetStats() { stats = GLStateStats(); }
+
+	static const unsigned int MAX_TEXTURE_UNITS = 32;
+	static const unsigned int MAX_BUFFER_BINDINGS = 16;
+
+private:
+	// generic binding points tracked by BindBuffer
+	enum BufferTarget { ARRAY, UNIFORM, COPY_READ, COPY_WRITE, SHADER_STORAGE, DRAW_INDIRECT, BUFFER_TARGETS };
+	struct IndexedBinding {
+		unsigned int buffer;
+		size_t offset;
+		size_t size;	// 0 for the whole buffer (BindBufferBase)
+	};
+	struct TextureBinding {
+		GLenum target;
+		unsigned int texture;
+	};
+	// capabilities tracked by Enable/Disable
+	enum Capability { BLEND, DEPTH_TEST, CULL_FACE, CAPABILITIES };
+
+	unsigned int program;
+	unsigned int vao;
+	unsigned int buffers[BUFFER_TARGETS];
+	IndexedBinding uniformBindings[MAX_BUFFER_BINDINGS];
+	IndexedBinding storageBindings[MAX_BUFFER_BINDINGS];
+	unsigned int activeUnit;
+	TextureBinding textures[MAX_TEXTURE_UNITS];
+	bool capabilities[CAPABILITIES];
+	GLenum blendSource, blendDestination;
+	GLenum depthFunction;
+	bool depthWrite;
+	bool colorWrite;
+	GLStateStats stats;
+
+	bool changed(bool different);
+	static int bufferTarget(GLenum target);
+	static int capability(GLenum capability);
+	IndexedBinding *indexedBinding(GLenum target, unsigned int index);
+};
+
+// state of the one GL context
+GLState &glState();
+
+#endif // GL_STATE_H
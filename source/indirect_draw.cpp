@@ -0,0 +1,83 @@
+#include "indirect_draw.h"
+#include "mesh.h"
+#include "geometry_pool.h"
+#include "gl_state.h"
+
+#include <cstring>
+
+IndirectDrawBuffer::IndirectDrawBuffer() {
+	commandRange.buffer = 0;
+	dataRange.buffer = 0;
+}
+
+bool IndirectDrawBuffer::Supported() {
+	return GLAD_GL_VERSION_4_6 != 0;
+}
+
+void IndirectDrawBuffer::Clear() {
+	commands.clear();
+	drawData.clear();
+	groups.clear();
+}
+
+bool IndirectDrawBuffer::Add(Mesh &mesh, unsigned int lod, const ClusterCullView *view, ClusterCullStats *stats,
+							 ShadingLOD shading) {
+	if(mesh.translucent)
+		return false;
+	unsigned int first = commands.size();
+	mesh.AppendDraws(commands, drawData, lod, view, stats);
+	unsigned int count = commands.size() - first;
+	if(count == 0)
+		return true;
+	// meshes with the same textures and shader features extend the group of the previous one
+	unsigned int features = mesh.ShaderFeatures(lod, shading);
+	if(!groups.empty() && groups.back().features == features &&
+	   groups.back().mesh->SameTextures(groups.back().lod, mesh, lod)) {
+		groups.back().count += count;
+		return true;
+	}
+	Group group;
+	group.mesh = &mesh;
+	group.lod = lod;
+	group.features = features;
+	group.first = first;
+	group.count = count;
+	groups.push_back(group);
+	return true;
+}
+
+void IndirectDrawBuffer::Upload() {
+	if(commands.empty())
+		return;
+	// written straight into this frame's region of the stream buffer
+	StreamBuffer &stream = streamBuffer();
+	commandRange = stream.Allocate(commands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+	std::memcpy(commandRange.data, &commands[0], commandRange.size);
+	stream.Commit(commandRange);
+
+	dataRange = stream.Allocate(drawData.size() * sizeof(DrawData), stream.StorageAlignment());
+	std::memcpy(dataRange.data, &drawData[0], dataRange.size);
+	stream.Commit(dataRange);
+}
+
+void IndirectDrawBuffer::Execute(ShaderPermutations &shaders, unsigned int features, bool positionsOnly) {
+	if(commands.empty())
+		return;
+	glState().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandRange.buffer);
+	glState().BindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, dataRange.buffer, dataRange.offset, dataRange.size);
+	if(features & SHADER_VERTEX_PULLING)
+		geometryPool().BindStreams(positionsOnly);
+	else
+		geometryPool().Bind(positionsOnly);
+	for(size_t i = 0; i < groups.size(); i++) {
+		const Group &group = groups[i];
+		Shader &shader = shaders.Get(positionsOnly ? features : features | group.features);
+		shader.use();
+		if(!positionsOnly)
+			group.mesh->BindTextures(group.lod);
+		shader.setInt(UNIFORM_DRAW_OFFSET, group.first);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+									(const void*)(commandRange.offset + group.first * sizeof(DrawElementsIndirectCommand)), group.count, 0);
+	}
+	geometryPool().Unbind();
+}
@@ -0,0 +1,82 @@
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "meshlet.h"
+#include "shader.h"
+#include "stream_buffer.h"
+
+#include <vector>
+
+class Mesh;
+
+// shader storage bindings of the per-draw data (resources/shaders/vertex_input.glsl)
+// and of the vertex streams read by vertex pulling
+enum StorageBufferBinding {
+	DRAW_DATA_BINDING = 0,
+	POSITION_STREAM_BINDING = 1,
+	ATTRIBUTE_STREAM_BINDING = 2
+};
+
+// layout defined by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// per-draw data, fetched in the vertex shader with gl_DrawID (std430 layout)
+struct DrawData {
+	glm::vec4 positionOffset;
+	glm::vec4 positionScale;
+	GLuint material;
+	// diffuse, specular and normal map layer in the bound texture arrays
+	GLuint layers[3];
+};
+
+/*
+draws of a frame as indirect commands in a GPU buffer. meshes append their (culled) ranges,
+consecutive meshes with the same textures form one group, and every group is a single
+glMultiDrawElementsIndirect. gl_DrawID restarts in each call, the shader adds the drawOffset
+uniform of the group to find its DrawData
+*/
+class IndirectDrawBuffer {
+public:
+	IndirectDrawBuffer();
+	// glMultiDrawElementsIndirect and gl_DrawID need GL 4.6 (or 4.3 with ARB_shader_draw_parameters)
+	static bool Supported();
+
+	void Clear();
+	// the mesh must be IndirectDrawable. false if it is translucent and needs the sorted transparent
+	// pass, it has to be drawn directly then
+	bool Add(Mesh &mesh, unsigned int lod, const ClusterCullView *view = NULL, ClusterCullStats *stats = NULL,
+			 ShadingLOD shading = SHADING_FULL);
+	void Upload();
+	// draws every group with the permutation of features (SHADER_INDIRECT, optionally
+	// SHADER_VERTEX_PULLING) and, unless positionsOnly, the material features of its mesh
+	void Execute(ShaderPermutations &shaders, unsigned int features, bool positionsOnly);
+
+	size_t CommandCount() const { return commands.size(); }
+	// glMultiDrawElementsIndirect calls of the last Execute
+	size_t DrawCalls() const { return groups.size(); }
+
+private:
+	struct Group {
+		Mesh *mesh;	// textures to bind
+		unsigned int lod;
+		unsigned int features;	// of the mesh, see Mesh::ShaderFeatures
+		unsigned int first;
+		unsigned int count;
+	};
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<DrawData> drawData;
+	std::vector<Group> groups;
+	// ranges of the stream buffer written by Upload
+	StreamAllocation commandRange, dataRange;
+};
+
+#endif // INDIRECT_DRAW_H
@@ -0,0 +1,54 @@
+#include "instance_buffer.h"
+#include "gl_state.h"
+#include "stream_buffer.h"
+
+#include <cstring>
+
+InstanceBuffer::InstanceBuffer() {
+	glGenBuffers(1, &VBO);
+	buffer = VBO;
+	offset = 0;
+	count = 0;
+	capacity = 0;
+}
+
+void InstanceBuffer::computeInstances(const std::vector<glm::mat4> &transforms) {
+	instances.resize(transforms.size());
+	for(size_t i = 0; i < transforms.size(); i++) {
+		instances[i].model = transforms[i];
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transforms[i])));
+		for(int c = 0; c < 3; c++)
+			instances[i].normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+	}
+	count = instances.size();
+}
+
+void InstanceBuffer::Update(const std::vector<glm::mat4> &transforms) {
+	computeInstances(transforms);
+	buffer = VBO;
+	offset = 0;
+	if(instances.empty())
+		return;
+
+	size_t bytes = instances.size() * sizeof(InstanceData);
+	glState().BindBuffer(GL_ARRAY_BUFFER, VBO);
+	if(bytes > capacity) {
+		glBufferData(GL_ARRAY_BUFFER, bytes, &instances[0], GL_DYNAMIC_DRAW);
+		capacity = bytes;
+	}
+	else {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &instances[0]);
+	}
+}
+
+void InstanceBuffer::Stream(const std::vector<glm::mat4> &transforms) {
+	computeInstances(transforms);
+	if(instances.empty())
+		return;
+	StreamBuffer &stream = streamBuffer();
+	StreamAllocation range = stream.Allocate(instances.size() * sizeof(InstanceData), sizeof(glm::vec4));
+	std::memcpy(range.data, &instances[0], range.size);
+	stream.Commit(range);
+	buffer = range.buffer;
+	offset = range.offset;
+}
@@ -0,0 +1,44 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// first vertex attribute location of the per-instance data (resources/shaders/vertex_input.glsl)
+const unsigned int INSTANCE_ATTRIBUTE_LOCATION = 3;
+
+// per-instance vertex attributes: model matrix in locations 3-6, normal matrix in 7-9
+struct InstanceData {
+	glm::mat4 model;
+	// transpose(inverse(mat3(model))), padded columns
+	glm::vec4 normalMatrix[3];
+};
+
+// transforms of the instances of a model, read as instanced vertex attributes (divisor 1)
+class InstanceBuffer {
+public:
+	InstanceBuffer();
+	// computes the normal matrices and uploads everything, for transforms that rarely change
+	void Update(const std::vector<glm::mat4> &transforms);
+	// same for transforms that change every frame: they are written to the stream buffer instead
+	void Stream(const std::vector<glm::mat4> &transforms);
+
+	// buffer and byte offset the attributes are read from
+	unsigned int ID() const { return buffer; }
+	size_t Offset() const { return offset; }
+	unsigned int Count() const { return count; }
+
+private:
+	unsigned int VBO;
+	unsigned int buffer;
+	size_t offset;
+	unsigned int count;
+	size_t capacity;
+	std::vector<InstanceData> instances;
+
+	void computeInstances(const std::vector<glm::mat4> &transforms);
+};
+
+#endif // INSTANCE_BUFFER_H
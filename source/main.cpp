@@ -12,8 +12,15 @@
 // self-written implementations
 #include "shader.h"
 #include "model.h"
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "stream_buffer.h"
+#include "allocation_tracker.h"
 // standard libraries
 #include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 // SOURCE: https://learnopengl.com/
 
@@ -29,8 +36,29 @@ void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 1200;
 
+// LOD selection: max screen space error of a LOD in pixels
+const float LOD_PIXEL_ERROR = 1.0f;
+// baked normal maps keep the shading detail, only the silhouette error remains visible
+const float LOD_PIXEL_ERROR_BAKED = 3.0f;
+
+// shading LOD: projected radius in pixels below which a mesh drops its material maps, and is lit per vertex
+const float SHADING_SIMPLE_RADIUS = 96.0f;
+const float SHADING_VERTEX_RADIUS = 24.0f;
+// geometry LODs that get the cheaper tiers at any size
+const unsigned int SHADING_SIMPLE_LOD = 2;
+const unsigned int SHADING_VERTEX_LOD = 3;
+
+// instanced grid: copies per side and distance between them
+const int INSTANCE_GRID_SIZE = 10;
+const float INSTANCE_GRID_SPACING = 2.0f;
+
 // button press detection
 bool buttonPressed = false;
+bool prepassButtonPressed = false;
+bool indirectButtonPressed = false;
+bool instancingButtonPressed = false;
+bool pullingButtonPressed = false;
+bool shadingButtonPressed = false;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -42,29 +70,60 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// statistics, shown in the window title once per second
+float statsTime = 0.0f;
+ClusterCullStats cullStats;
+RenderQueueStats queueStats;
+ShadingLODStats shadingStats;
+size_t drawCalls = 0;
+size_t frames = 0;
+// heap allocations of the render loop, none are expected once the first frames sized all containers
+FrameAllocationTracker frameAllocations;
+// render loop frames that size all containers, the allocation checks ignore them
+const unsigned int ALLOCATION_WARMUP_FRAMES = 60;
+// --check-allocations: the frames after the warm-up that must not allocate. the program exits
+// after them, with status 1 if any of them allocated
+const unsigned int ALLOCATION_CHECK_FRAMES = 600;
+
 // lighting
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 glm::vec3 ambientIntensity(0.2f, 0.2f, 0.2f);
 glm::vec3 diffuseIntensity(0.7f, 0.7f, 0.7f);
 glm::vec3 specularIntensity(1.0f, 1.0f, 1.0f);
 
-// material
-glm::vec3 ambientColor = glm::vec3(1.0f, 0.5f, 0.31f);
-glm::vec3 diffuseColor = glm::vec3(1.0f, 0.5f, 0.31f);
-glm::vec3 specularColor = glm::vec3(0.5f, 0.5f, 0.5f);
 // transparency
 float alpha = 1.0f;
+// depth pre-pass over the position stream (opaque only)
+bool depthPrepass = false;
+// whole model in one glMultiDrawElementsIndirect per texture set (GL 4.6 only)
+bool indirectDraw = true;
+// indirect draws read their vertices from storage buffers instead of vertex attributes
+bool vertexPulling = false;
+// grid of model copies, one draw per mesh for all of them
+bool instancedGrid = false;
+// cheaper shading for draws that are small on screen or use coarse LODs
+bool shadingLOD = true;
+
+int main(int argc, char *argv[]) {
+    // runs a fixed number of steady frames and fails if any of them allocates
+    bool checkAllocations = argc > 1 && std::strcmp(argv[1], "--check-allocations") == 0;
+    unsigned int loopFrames = 0, checkFailures = 0;
 
-int main() {
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // 4.6 for multi-draw indirect, everything else runs on 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CGSE", NULL, NULL);
+    if(window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CGSE", NULL, NULL);
+    }
     if(window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -91,21 +150,72 @@ int main() {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     // enable depth test (z-buffer)
-    glEnable(GL_DEPTH_TEST);
+    glState().Enable(GL_DEPTH_TEST);
 
     // enable blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // building the shader from the vertex and fragment shader paths
-    Shader shader("resources/shaders/shader.vs", "resources/shaders/shader.fs");
+    glState().Enable(GL_BLEND);
+    glState().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // building the shaders from the vertex and fragment shader paths. each pair is built per feature
+    // permutation, in the background while the model loads. the render loop uses the direct path
+    // until the permutations of the others are ready
+    ShaderPermutations shaders("resources/shaders/shader.vs", "resources/shaders/shader.fs");
+	ShaderPermutations depthShaders("resources/shaders/depth.vs", "resources/shaders/depth.fs");
 	Shader lampShader("resources/shaders/lamp_shader.vs", "resources/shaders/lamp_shader.fs");
+	// the base permutations of every path, they can draw any mesh
+	shaders.Prepare(0);
+	depthShaders.Prepare(0);
+	shaders.Prepare(SHADER_INSTANCED);
+	// multi-draw indirect, per-draw data is fetched with gl_DrawID
+	IndirectDrawBuffer *indirectDraws = NULL;
+	if(IndirectDrawBuffer::Supported()) {
+		shaders.Prepare(SHADER_INDIRECT);
+		depthShaders.Prepare(SHADER_INDIRECT);
+		shaders.Prepare(SHADER_INDIRECT | SHADER_VERTEX_PULLING);
+		depthShaders.Prepare(SHADER_INDIRECT | SHADER_VERTEX_PULLING);
+		indirectDraws = new IndirectDrawBuffer();
+	}
 
-	// model loading
+	// model loading (coarser LODs are generated at import, with normal and AO maps baked from the full detail)
+	ImportSettings importSettings;
+	importSettings.bakeNormalMaps = true;
+	importSettings.bake.ambientOcclusion = true;
 	std::vector<Model> models;
-	models.push_back(Model("resources/models/stillleben/stillleben_high.obj"));
-	models.push_back(Model("resources/models/stillleben/stillleben_medium.obj"));
-	models.push_back(Model("resources/models/stillleben/stillleben_low.obj"));
+	models.push_back(Model("resources/models/stillleben/stillleben_high.obj", importSettings));
+	float lodPixelError = importSettings.bakeNormalMaps ? LOD_PIXEL_ERROR_BAKED : LOD_PIXEL_ERROR;
+	// decided once at load: a mesh the indirect path can't draw would be missing from its frames
+	if(indirectDraws && !models[0].IndirectDrawable()) {
+		std::cout << "ERROR::INDIRECT::MESH_WITH_32_BIT_INDICES, using direct draws" << std::endl;
+		delete indirectDraws;
+		indirectDraws = NULL;
+	}
+	// the permutations the materials of the model need, others are built on first use
+	models[0].PrepareShaders(shaders, 0);
+	if(indirectDraws)
+		models[0].PrepareShaders(shaders, SHADER_INDIRECT);
+
+	// the checked frames must not switch paths when a program becomes ready
+	if(checkAllocations) {
+		shaders.Wait();
+		depthShaders.Wait();
+	}
+
+	// uniform buffers bound to the block binding points of all programs
+	UniformBuffer frameUniforms(sizeof(FrameUniforms), FRAME_UNIFORM_BINDING);
+	ObjectUniformBuffer objectUniforms;
+	// draws of a frame, sorted to minimize state changes
+	RenderQueue renderQueue;
+	// the grid doesn't move, its transforms are uploaded once
+	std::vector<glm::mat4> gridTransforms;
+	for(int x = 0; x < INSTANCE_GRID_SIZE; x++) {
+		for(int z = 0; z < INSTANCE_GRID_SIZE; z++) {
+			glm::vec3 offset((x - INSTANCE_GRID_SIZE / 2) * INSTANCE_GRID_SPACING, 0.0f,
+							 (z - INSTANCE_GRID_SIZE / 2) * INSTANCE_GRID_SPACING);
+			gridTransforms.push_back(glm::translate(glm::mat4(1.0f), offset));
+		}
+	}
+	InstanceBuffer gridInstances;
+	gridInstances.Update(gridTransforms);
 
     // uncomment this call to draw in wireframe polygons.
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -124,44 +234,189 @@ int main() {
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
+		frameAllocations.BeginFrame();
+
 		// input
         processInput(window);
 
+		// per-frame data goes to the next region of the stream buffer (waits if the GPU is 3 frames behind)
+		streamBuffer().BeginFrame();
+		// programs still being built may be waited for again (one per frame without parallel compiling)
+		beginShaderFrame();
+
         // rendering commands here:
 
         // clear colors:
         glClearColor(0.85f, 0.85f, 0.85f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// shader needs to be activated before accessing its uniforms
-        shader.use();
-        // lighting
-        shader.setVec3("light.ambient", ambientIntensity);
-        shader.setVec3("light.diffuse", diffuseIntensity);
-        shader.setVec3("light.specular", specularIntensity);
-		shader.setVec3("lightPos", lightPos);
-		shader.setVec3("viewPos", camera.Position);
-		// set alpha val
-		shader.setFloat("alpha", alpha);
-		// pass cam pos
-
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
-		shader.setMat4("projection", projection);
-		shader.setMat4("view", view);
-
 		glm::mat4 model = glm::mat4(1.0f);
-		shader.setMat4("model", model);
 
+		// pick the coarsest LOD whose simplification error stays below the pixel threshold
 		float length = glm::length(camera.Position);
-		if(length < 1.5f) {
-			models[0].Draw(shader);
+		float pixelScale = SCR_HEIGHT / (2.0f * glm::tan(glm::radians(camera.Zoom) * 0.5f));
+		unsigned int lod = models[0].SelectLOD(length, pixelScale, lodPixelError);
+
+		// camera and lights for all programs, one upload per frame
+		FrameUniforms frame;
+		frame.projection = projection;
+		frame.view = view;
+		frame.viewProjection = projection * view;
+		frame.viewPos = glm::vec4(camera.Position, 1.0f);
+		frame.lightPos = glm::vec4(lightPos, 1.0f);
+		frame.lightAmbient = glm::vec4(ambientIntensity, 0.0f);
+		frame.lightDiffuse = glm::vec4(diffuseIntensity, 0.0f);
+		frame.lightSpecular = glm::vec4(specularIntensity, 0.0f);
+		frame.alpha = alpha;
+		frameUniforms.Update(&frame, sizeof(frame));
+		// model matrices (with their normal matrices) of everything drawn this frame
+		objectUniforms.Reset();
+		unsigned int modelObject = objectUniforms.Add(model);
+		objectUniforms.Upload();
+
+		frameAllocations.BeginPhase(PHASE_SUBMIT);
+		// cluster culling happens in model space
+		ClusterCullView cullView;
+		cullView.frustum = extractFrustum(projection * view * model);
+		cullView.cameraPosition = glm::vec3(glm::inverse(model) * glm::vec4(camera.Position, 1.0f));
+		// see-through surfaces show their back faces, only frustum culling applies then
+		cullView.backfaceCulling = alpha == 1.0f;
+		ShadingLODView shadingView;
+		shadingView.cameraPosition = cullView.cameraPosition;
+		shadingView.pixelScale = pixelScale;
+		shadingView.simpleRadius = SHADING_SIMPLE_RADIUS;
+		shadingView.vertexRadius = SHADING_VERTEX_RADIUS;
+		shadingView.simpleLOD = SHADING_SIMPLE_LOD;
+		shadingView.vertexLOD = SHADING_VERTEX_LOD;
+		const ShadingLODView *shading = shadingLOD ? &shadingView : NULL;
+
+		// depth pre-pass: only positions are fetched, the shading pass then shades visible fragments only
+		bool prepass = depthPrepass && alpha == 1.0f;
+		// see-through frames draw every mesh with the alpha permutation
+		unsigned int features = alpha == 1.0f ? 0 : SHADER_ALPHA;
+		// multi-draw indirect for opaque draws, transparent ones need the sorted queue
+		bool indirect = indirectDraw && indirectDraws && shaders.Ready(SHADER_INDIRECT) &&
+						depthShaders.Ready(SHADER_INDIRECT) && alpha == 1.0f;
+		unsigned int indirectFeatures = SHADER_INDIRECT;
+		if(vertexPulling && indirect && shaders.Ready(SHADER_INDIRECT | SHADER_VERTEX_PULLING) &&
+		   depthShaders.Ready(SHADER_INDIRECT | SHADER_VERTEX_PULLING))
+			indirectFeatures |= SHADER_VERTEX_PULLING;
+		if(instancedGrid && shaders.Ready(features | SHADER_INSTANCED)) {
+			frameAllocations.BeginPhase(PHASE_DRAW);
+			// no culling or sorting, every mesh is drawn once for all instances
+			models[0].DrawInstanced(shaders, features, gridInstances, lod);
+			drawCalls += models[0].MeshCount();
+		}
+		else if(indirect) {
+			indirectDraws->Clear();
+			models[0].Submit(*indirectDraws, lod, &cullView, &cullStats, shading, &shadingStats);
+			indirectDraws->Upload();
+			// translucent materials are blended back to front after the opaque indirect draws
+			renderQueue.Clear();
+			models[0].SubmitTranslucent(renderQueue, shaders, features, lod, modelObject, cullView, &cullStats,
+										shading, &shadingStats);
+			renderQueue.Sort();
+			frameAllocations.BeginPhase(PHASE_DRAW);
+			objectUniforms.Bind(modelObject);
+
+			if(prepass) {
+				glState().ColorMask(false);
+				indirectDraws->Execute(depthShaders, indirectFeatures, true);
+				glState().ColorMask(true);
+				glState().DepthFunc(GL_LEQUAL);
+			}
+			indirectDraws->Execute(shaders, indirectFeatures, false);
+			drawCalls += (prepass ? 2 : 1) * indirectDraws->DrawCalls();
+			size_t queueDraws = queueStats.draws;
+			renderQueue.Execute(PASS_TRANSPARENT, objectUniforms, &queueStats);
+			drawCalls += queueStats.draws - queueDraws;
 		}
-		else if(length > 1.5f && length < 5.0f) {
-			models[1].Draw(shader);
+		else {
+			renderQueue.Clear();
+			if(prepass)
+				models[0].Submit(renderQueue, depthShaders, 0, PASS_DEPTH, lod, modelObject, cullView);
+			models[0].Submit(renderQueue, shaders, features, alpha == 1.0f ? PASS_OPAQUE : PASS_TRANSPARENT, lod,
+							 modelObject, cullView, &cullStats, shading, &shadingStats);
+			renderQueue.Sort();
+			frameAllocations.BeginPhase(PHASE_DRAW);
+
+			size_t queueDraws = queueStats.draws;
+			if(prepass) {
+				glState().ColorMask(false);
+				renderQueue.Execute(PASS_DEPTH, objectUniforms, &queueStats);
+				glState().ColorMask(true);
+				glState().DepthFunc(GL_LEQUAL);
+			}
+			renderQueue.Execute(PASS_OPAQUE, objectUniforms, &queueStats);
+			renderQueue.Execute(PASS_TRANSPARENT, objectUniforms, &queueStats);
+			drawCalls += queueStats.draws - queueDraws;
 		}
-		else if(length > 5.0f) {
-			models[2].Draw(shader);
+		if(prepass)
+			glState().DepthFunc(GL_LESS);
+
+		frameAllocations.EndFrame();
+		loopFrames++;
+
+		frames++;
+		if(currentFrame - statsTime >= 1.0f) {
+			// formatted into a fixed buffer, a stream would allocate
+			char title[512];
+			std::snprintf(title, sizeof(title), "CGSE | draw calls per frame: %zu | meshes culled per frame: %zu of %zu, "
+						  "groups culled: %zu%%, clusters culled: %zu%%, "
+						  "triangles culled: %zu%% | state changes per frame: %zu unsorted, %zu sorted | "
+						  "GL calls filtered per frame: %zu of %zu | heap allocations per frame: %zu | "
+						  "shading LOD draws: %zu full, %zu simple, %zu per vertex",
+						  drawCalls / frames, cullStats.meshesCulled / frames, cullStats.meshes / frames,
+						  100 * cullStats.groupsCulled / std::max<size_t>(cullStats.groups, 1),
+						  100 * cullStats.meshletsCulled / std::max<size_t>(cullStats.meshlets, 1),
+						  100 * cullStats.trianglesCulled / std::max<size_t>(cullStats.triangles, 1),
+						  queueStats.unsortedStateChanges / frames, queueStats.stateChanges / frames,
+						  glState().Stats().filtered / frames, (glState().Stats().filtered + glState().Stats().issued) / frames,
+						  (frameAllocations.Phase(PHASE_UPDATE).allocations + frameAllocations.Phase(PHASE_SUBMIT).allocations +
+						   frameAllocations.Phase(PHASE_DRAW).allocations) / std::max<size_t>(frameAllocations.Frames(), 1),
+						  shadingStats.draws[SHADING_FULL] / frames, shadingStats.draws[SHADING_SIMPLE] / frames,
+						  shadingStats.draws[SHADING_VERTEX] / frames);
+			glfwSetWindowTitle(window, title);
+			// a steady frame must not allocate, periods that include warm-up frames aren't checked
+			bool warmedUp = loopFrames - frameAllocations.Frames() >= ALLOCATION_WARMUP_FRAMES;
+			if(warmedUp && frameAllocations.AllocatingFrames() > 0) {
+				for(int i = 0; i < FRAME_PHASES; i++) {
+					const AllocationStats &phase = frameAllocations.Phase((FramePhase)i);
+					if(phase.allocations > 0)
+						std::cout << "ERROR::FRAME::HEAP_ALLOCATIONS " << FrameAllocationTracker::PhaseName((FramePhase)i)
+								  << ": " << phase.allocations / frameAllocations.Frames() << " allocations ("
+								  << phase.bytes / frameAllocations.Frames() << " bytes) per frame in "
+								  << frameAllocations.AllocatingFrames() << " of " << frameAllocations.Frames() << " frames"
+								  << std::endl;
+				}
+			}
+			frameAllocations.ResetStats();
+			cullStats = ClusterCullStats();
+			queueStats = RenderQueueStats();
+			shadingStats = ShadingLODStats();
+			drawCalls = 0;
+			glState().ResetStats();
+			frames = 0;
+			statsTime = currentFrame;
+		}
+
+		// the region of this frame is reused once the GPU passes this point
+		streamBuffer().EndFrame();
+
+		if(checkAllocations) {
+			for(int i = 0; loopFrames > ALLOCATION_WARMUP_FRAMES && i < FRAME_PHASES; i++) {
+				size_t allocations = frameAllocations.LastFrame((FramePhase)i);
+				if(allocations == 0)
+					continue;
+				std::cout << "ERROR::FRAME::HEAP_ALLOCATIONS frame " << loopFrames << " "
+						  << FrameAllocationTracker::PhaseName((FramePhase)i) << ": " << allocations << " allocations"
+						  << std::endl;
+				checkFailures++;
+			}
+			if(loopFrames == ALLOCATION_WARMUP_FRAMES + ALLOCATION_CHECK_FRAMES)
+				glfwSetWindowShouldClose(window, true);
 		}
 
         // swap buffer and poll IO events
@@ -170,6 +425,11 @@ int main() {
     }
 
     glfwTerminate();
+    if(checkAllocations) {
+        std::cout << "allocation check: " << checkFailures << " allocating phases in " << ALLOCATION_CHECK_FRAMES
+                  << " frames" << std::endl;
+        return checkFailures == 0 ? 0 : 1;
+    }
     return 0;
 }
 
@@ -193,6 +453,45 @@ void processInput(GLFWwindow* window) {
 		alpha = alpha == 1.0f ? 0.3f : 1.0f;
 		buttonPressed = false;
 	}
+
+	// toggle depth pre-pass
+	if(glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !prepassButtonPressed)
+		prepassButtonPressed = true;
+	if(glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE && prepassButtonPressed) {
+		depthPrepass = !depthPrepass;
+		prepassButtonPressed = false;
+	}
+
+	if(glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && !indirectButtonPressed)
+		indirectButtonPressed = true;
+	if(glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE && indirectButtonPressed) {
+		indirectDraw = !indirectDraw;
+		indirectButtonPressed = false;
+	}
+
+	// toggle vertex pulling for indirect draws
+	if(glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && !pullingButtonPressed)
+		pullingButtonPressed = true;
+	if(glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE && pullingButtonPressed) {
+		vertexPulling = !vertexPulling;
+		pullingButtonPressed = false;
+	}
+
+	// toggle shading LOD
+	if(glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !shadingButtonPressed)
+		shadingButtonPressed = true;
+	if(glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE && shadingButtonPressed) {
+		shadingLOD = !shadingLOD;
+		shadingButtonPressed = false;
+	}
+
+	// toggle the instanced grid
+	if(glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !instancingButtonPressed)
+		instancingButtonPressed = true;
+	if(glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE && instancingButtonPressed) {
+		instancedGrid = !instancedGrid;
+		instancingButtonPressed = false;
+	}
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
@@ -1,85 +1,325 @@
 #include "mesh.h"
+#include "quantize.h"
+#include "geometry_pool.h"
+#include "gl_state.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <vector>
 #include <iostream>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) {
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+		   std::vector<MeshLOD> lods, std::vector<Meshlet> meshlets, std::vector<MeshletGroup> meshletGroups) {
 	this->vertices = vertices;
 	this->indices = indices;
 	this->textures = textures;
+	this->lods = lods;
+	this->meshlets = meshlets;
+	this->meshletGroups = meshletGroups;
+	this->materialIndex = 0;
+	this->translucent = false;
+	// without a LOD chain the whole index buffer is the only level
+	if(this->lods.empty()) {
+		MeshLOD lod;
+		lod.indexOffset = 0;
+		lod.indexCount = this->indices.size();
+		lod.error = 0.0f;
+		this->lods.push_back(lod);
+	}
+	// ungrouped meshlets form a single group
+	if(this->meshletGroups.empty() && !this->meshlets.empty())
+		this->meshletGroups.push_back(groupMeshlets(this->meshlets, 0, this->meshlets.size()));
+
+	// texture units, this function assumes that a mesh can have multiples of each texture variant
+	unsigned int diffuseNr = 1;
+	unsigned int specularNr = 1;
+	unsigned int normalNr = 1;
+	for(unsigned int i = 0; i < this->textures.size(); i++) {
+		const std::string &name = this->textures[i].type;
+		unsigned int number = 0;
+		if(name == "texture_diffuse")
+			number = diffuseNr++;
+		else if(name == "texture_specular")
+			number = specularNr++;
+		else if(name == "texture_normal")
+			number = normalNr++;
+		textureUnits.push_back(number > 0 ? materialTextureUnit(name, number) : -1);
+	}
 
+	computeBounds();
 	setupMesh();
 }
 
+void Mesh::computeBounds() {
+	bounds.min = bounds.max = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+	for(size_t i = 1; i < vertices.size(); i++) {
+		bounds.min = glm::min(bounds.min, vertices[i].Position);
+		bounds.max = glm::max(bounds.max, vertices[i].Position);
+	}
+	// tighter than the half diagonal for most shapes
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	float radius2 = 0.0f;
+	for(size_t i = 0; i < vertices.size(); i++) {
+		glm::vec3 d = vertices[i].Position - bounds.center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	bounds.radius = std::sqrt(radius2);
+}
+
+bool Mesh::Visible(const ClusterCullView &view, ClusterCullStats *stats) const {
+	// the sphere decides most meshes in one pass, the tighter box is only tested when it crosses a plane
+	FrustumOverlap overlap = sphereFrustumOverlap(view.frustum, bounds.center, bounds.radius);
+	bool visible = overlap == FRUSTUM_INSIDE || (overlap == FRUSTUM_INTERSECTING &&
+				   boxInFrustum(view.frustum, bounds.center, (bounds.max - bounds.min) * 0.5f));
+	if(stats) {
+		stats->meshes++;
+		if(!visible)
+			stats->meshesCulled++;
+	}
+	return visible;
+}
+
 void Mesh::setupMesh() {
 	/*
-	VAO aka vertex attribute object: holds buffer data
-	VBO aka vertex buffer object: holds vertex data
-	EBO aka element buffer object: holds vertex data in an indexed fashion (for indexed drawing mode)
+	vertices are split into a position and an attribute stream and indices go to an index buffer,
+	all of them ranges in the buffers of the shared geometry pool. the pool's full VAO reads both
+	streams, its depth VAO only the positions, for passes that need no shading inputs
 	*/
-	// generate objects
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	// bind VAO before buffer configurations
-	glBindVertexArray(VAO);
-
-	// copy to buffers (bind first):
-	// VBO
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-	// EBO
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-	// set vertex data attributes:
-	// vertex positions
-	glEnableVertexAttribArray(0);	// location 0
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	// vertex normals
-	glEnableVertexAttribArray(1);	// location 1
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-					   (void*)offsetof(Vertex, Normal));
-	// vertex texture coords
-	glEnableVertexAttribArray(2);	// location 2
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-					   (void*)offsetof(Vertex, TexCoord));
-	// vertex tangent normals
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-						  (void*)offsetof(Vertex, Tangent));
-
-	// unbind VAO
-	glBindVertexArray(0);
-
-}
-
-void Mesh::Draw(Shader &shader) {
-	// this function assumes that a mesh can have multiples of each texture variant
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-	unsigned int normalNr = 1;
+	// quantize vertices into the compact GPU layout
+	QuantizationBounds bounds = computeQuantizationBounds(vertices);
+	positionOffset = bounds.offset;
+	positionScale = bounds.scale;
+	std::vector<PackedPosition> positions;
+	std::vector<PackedAttributes> attributes;
+	packVertices(vertices, bounds, positions, attributes);
+
+	GeometryPool &pool = geometryPool();
+	vertexAllocation = pool.AllocateVertices(positions, attributes);
+
+	// 16-bit indices whenever the vertex count allows it
+	if(vertices.size() <= 65536) {
+		std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+		indexType = GL_UNSIGNED_SHORT;
+		indexSize = sizeof(unsigned short);
+		indexAllocation = pool.AllocateIndices(shortIndices.data(), shortIndices.size() * indexSize);
+	}
+	else {
+		indexType = GL_UNSIGNED_INT;
+		indexSize = sizeof(unsigned int);
+		indexAllocation = pool.AllocateIndices(indices.data(), indices.size() * indexSize);
+	}
+}
+
+void Mesh::Release() {
+	geometryPool().Free(vertexAllocation);
+	geometryPool().Free(indexAllocation);
+}
+
+void Mesh::Draw(Shader &shader, unsigned int lod, const ClusterCullView *view, ClusterCullStats *stats) {
+	BindTextures(lod);
+	DrawGeometry(shader, false, lod, view, stats);
+}
+
+void Mesh::DrawDepth(Shader &shader, unsigned int lod, const ClusterCullView *view, ClusterCullStats *stats) {
+	DrawGeometry(shader, true, lod, view, stats);
+}
+
+void Mesh::BindTextures(unsigned int lod) {
+	// coarser levels than available use the maps of the coarsest one
+	if(lod >= lods.size())
+		lod = lods.size() - 1;
+
+	// samplers were assigned their units when the shader was linked
+	bool bakedNormalMap = lod < lodNormalMaps.size() && lodNormalMaps[lod].id != 0;
 	for(unsigned int i = 0; i < textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		std::string number;
-		std::string name = textures[i].type;
-		if(name == "texture_diffuse")
-			number = std::to_string(diffuseNr++);
-		else if(name == "texture_specular")
-			number = std::to_string(specularNr++);
-		else if(name == "texture_normal")
-			number = std::to_string(normalNr++);
+		if(textureUnits[i] < 0 || (textureUnits[i] == TEXTURE_UNIT_NORMAL && bakedNormalMap))
+			continue;
+		glState().BindTexture(textureUnits[i], GL_TEXTURE_2D_ARRAY, textures[i].id);
+	}
+	// also for materials without a normal map of their own
+	if(bakedNormalMap)
+		glState().BindTexture(TEXTURE_UNIT_NORMAL, GL_TEXTURE_2D_ARRAY, lodNormalMaps[lod].id);
+}
+
+unsigned int Mesh::ShaderFeatures(unsigned int lod, ShadingLOD shading) const {
+	if(lod >= lods.size())
+		lod = lods.size() - 1;
+	unsigned int features = translucent ? SHADER_ALPHA : 0;
+	// the cheaper tiers bind the maps anyway, their permutations just don't sample them
+	if(shading == SHADING_SIMPLE)
+		return features;
+	if(shading == SHADING_VERTEX)
+		return features | SHADER_VERTEX_LIGHTING;
+	for(unsigned int i = 0; i < textures.size(); i++) {
+		if(textureUnits[i] == TEXTURE_UNIT_NORMAL)
+			features |= SHADER_NORMAL_MAP;
+		else if(textureUnits[i] == TEXTURE_UNIT_SPECULAR)
+			features |= SHADER_SPECULAR_MAP;
+	}
+	if(lod < lodNormalMaps.size() && lodNormalMaps[lod].id != 0)
+		features |= SHADER_NORMAL_MAP;
+	return features;
+}
+
+glm::vec3 Mesh::MaterialLayers(unsigned int lod) const {
+	if(lod >= lods.size())
+		lod = lods.size() - 1;
+	// the shaders sample the first texture of each type
+	glm::vec3 layers(0.0f);
+	for(unsigned int i = 0; i < textures.size(); i++) {
+		if(textureUnits[i] >= 0 && textureUnits[i] < MATERIAL_TEXTURE_UNITS)
+			layers[textureUnits[i]] = textures[i].layer;
+	}
+	if(lod < lodNormalMaps.size() && lodNormalMaps[lod].id != 0)
+		layers[TEXTURE_UNIT_NORMAL] = lodNormalMaps[lod].layer;
+	return layers;
+}
+
+bool Mesh::SameTextures(unsigned int lod, const Mesh &other, unsigned int otherLod) const {
+	if(this == &other && lod == otherLod)
+		return true;
+	if(textures.size() != other.textures.size())
+		return false;
+	for(unsigned int i = 0; i < textures.size(); i++) {
+		if(textures[i].id != other.textures[i].id)
+			return false;
+	}
+	// including the baked normal map of the LOD
+	unsigned int normalMap = lod < lodNormalMaps.size() ? lodNormalMaps[lod].id : 0;
+	unsigned int otherNormalMap = otherLod < other.lodNormalMaps.size() ? other.lodNormalMaps[otherLod].id : 0;
+	return normalMap == otherNormalMap;
+}
 
-		// IMPORTANT: this depends on the uniforms names in the shader
-		//shader.setFloat((name + number).c_str(), i);		<-- DOESN'T WORK
-		glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+void Mesh::DrawGeometry(Shader &shader, bool positionsOnly, unsigned int lod, const ClusterCullView *view,
+						ClusterCullStats *stats) {
+	// dequantization of the packed positions
+	shader.setVec3(UNIFORM_POSITION_OFFSET, positionOffset);
+	shader.setVec3(UNIFORM_POSITION_SCALE, positionScale);
+	if(!positionsOnly)
+		shader.setVec4(UNIFORM_MATERIAL, glm::vec4(MaterialLayers(lod), materialIndex));
+
+	// draw mesh (clamped to the coarsest available level)
+	GeometryPool &pool = geometryPool();
+	pool.Bind(positionsOnly);
+	const MeshLOD &level = lods[lod < lods.size() ? lod : lods.size() - 1];
+	if(view && &level == &lods[0] && !meshlets.empty())
+		drawMeshlets(*view, stats);
+	else
+		glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, indexType,
+								 (void*)(pool.Offset(indexAllocation) + level.indexOffset * indexSize),
+								 pool.Offset(vertexAllocation));
+}
+
+void Mesh::DrawInstanced(Shader &shader, const InstanceBuffer &instances, unsigned int lod) {
+	if(instances.Count() == 0)
+		return;
+	BindTextures(lod);
+	shader.setVec3(UNIFORM_POSITION_OFFSET, positionOffset);
+	shader.setVec3(UNIFORM_POSITION_SCALE, positionScale);
+	shader.setVec4(UNIFORM_MATERIAL, glm::vec4(MaterialLayers(lod), materialIndex));
+
+	// no meshlet culling, the meshlet bounds are only valid for a single transform
+	GeometryPool &pool = geometryPool();
+	pool.BindInstanced(instances);
+	const MeshLOD &level = lods[lod < lods.size() ? lod : lods.size() - 1];
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, indexType,
+									  (void*)(pool.Offset(indexAllocation) + level.indexOffset * indexSize),
+									  instances.Count(), pool.Offset(vertexAllocation));
+}
+
+void Mesh::cullMeshlets(const ClusterCullView &cameraView, ClusterCullStats *stats) {
+	// the back faces of translucent meshes show through their front faces
+	ClusterCullView view = cameraView;
+	if(translucent)
+		view.backfaceCulling = false;
+	drawCounts.clear();
+	drawFirsts.clear();
+	size_t groupsCulled = 0, culled = 0, trianglesCulled = 0;
+	// visible meshlets next to each other in the index buffer merge into one range
+	unsigned int rangeEnd = ~0u;
+	for(unsigned int g = 0; g < meshletGroups.size(); g++) {
+		const MeshletGroup &group = meshletGroups[g];
+		// groups outside the frustum skip the test of each of their meshlets
+		if(!sphereInFrustum(view.frustum, group.center, group.radius)) {
+			groupsCulled++;
+			culled += group.meshletCount;
+			trianglesCulled += group.indexCount / 3;
+			continue;
+		}
+		for(unsigned int i = group.meshletOffset; i < group.meshletOffset + group.meshletCount; i++) {
+			const Meshlet &meshlet = meshlets[i];
+			if(cullMeshlet(meshlet, view)) {
+				culled++;
+				trianglesCulled += meshlet.indexCount / 3;
+				continue;
+			}
+			if(meshlet.indexOffset == rangeEnd) {
+				drawCounts.back() += meshlet.indexCount;
+			}
+			else {
+				drawCounts.push_back(meshlet.indexCount);
+				drawFirsts.push_back(meshlet.indexOffset);
+			}
+			rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+		}
+	}
+
+	if(stats) {
+		stats->groups += meshletGroups.size();
+		stats->groupsCulled += groupsCulled;
+		stats->meshlets += meshlets.size();
+		stats->meshletsCulled += culled;
+		stats->triangles += lods[0].indexCount / 3;
+		stats->trianglesCulled += trianglesCulled;
 	}
-	glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::drawMeshlets(const ClusterCullView &view, ClusterCullStats *stats) {
+	cullMeshlets(view, stats);
+	if(drawCounts.empty())
+		return;
+	GeometryPool &pool = geometryPool();
+	size_t indexStart = pool.Offset(indexAllocation);
+	drawOffsets.resize(drawFirsts.size());
+	for(size_t i = 0; i < drawFirsts.size(); i++)
+		drawOffsets[i] = (const void*)(indexStart + drawFirsts[i] * indexSize);
+	drawBaseVertices.assign(drawCounts.size(), (GLint)pool.Offset(vertexAllocation));
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, &drawCounts[0], indexType, &drawOffsets[0], drawCounts.size(),
+								  &drawBaseVertices[0]);
+}
+
+void Mesh::AppendDraws(std::vector<DrawElementsIndirectCommand> &commands, std::vector<DrawData> &drawData,
+					   unsigned int lod, const ClusterCullView *view, ClusterCullStats *stats) {
+	// one index type per indirect submission, decided for the whole model at load
+	assert(IndirectDrawable());
 
-	// draw mesh
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	const MeshLOD &level = lods[lod < lods.size() ? lod : lods.size() - 1];
+	if(view && &level == &lods[0] && !meshlets.empty()) {
+		cullMeshlets(*view, stats);
+	}
+	else {
+		drawCounts.assign(1, level.indexCount);
+		drawFirsts.assign(1, level.indexOffset);
+	}
+
+	GeometryPool &pool = geometryPool();
+	DrawElementsIndirectCommand command;
+	command.instanceCount = 1;
+	command.baseVertex = pool.Offset(vertexAllocation);
+	command.baseInstance = 0;
+	DrawData data;
+	data.positionOffset = glm::vec4(positionOffset, 0.0f);
+	data.positionScale = glm::vec4(positionScale, 0.0f);
+	data.material = materialIndex;
+	glm::vec3 layers = MaterialLayers(lod);
+	for(int i = 0; i < 3; i++)
+		data.layers[i] = layers[i];
+	unsigned int firstIndex = pool.Offset(indexAllocation) / indexSize;
+	for(size_t i = 0; i < drawCounts.size(); i++) {
+		command.count = drawCounts[i];
+		command.firstIndex = firstIndex + drawFirsts[i];
+		commands.push_back(command);
+		drawData.push_back(data);
+	}
 }
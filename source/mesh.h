@@ -4,6 +4,9 @@
 #include <glm/glm.hpp>
 
 #include "shader.h"
+#include "meshlet.h"
+#include "indirect_draw.h"
+#include "instance_buffer.h"
 
 #include <vector>
 
@@ -11,13 +14,29 @@ struct Vertex {
 	glm::vec3 Position;
 	glm::vec3 Normal;
 	glm::vec2 TexCoord;
-	glm::vec3 Tangent;
+	glm::vec4 Tangent;	// w: bitangent sign
+};
+
+// a level of detail: a range of the mesh index buffer and the error it introduces
+struct MeshLOD {
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	float error;	// max deviation from the full detail surface (object space)
 };
 
 struct Texture {
-	unsigned int id;
+	unsigned int id;	// GL_TEXTURE_2D_ARRAY, see texture_array.h
 	std::string type;
 	std::string path;
+	unsigned int layer;
+};
+
+// bounds of a mesh in model space, computed from its vertices
+struct MeshBounds {
+	glm::vec3 min, max;
+	// sphere around the box center through the farthest vertex
+	glm::vec3 center;
+	float radius;
 };
 
 class Mesh {
@@ -26,16 +45,77 @@ public:
 	std::vector<Vertex> 		vertices;
 	std::vector<unsigned int> 	indices;
 	std::vector<Texture> 		textures;
+	// LOD 0 is the full detail mesh, coarser levels follow in the same index buffer
+	std::vector<MeshLOD>		lods;
+	// clusters of LOD 0
+	std::vector<Meshlet>		meshlets;
+	// runs of meshlets with a common bounding sphere (the source meshes of a static batch)
+	std::vector<MeshletGroup>	meshletGroups;
+	// material of the source meshes, index into the material table (see uniform_buffer.h)
+	unsigned int				materialIndex;
+	// per LOD normal map baked from LOD 0, replaces texture_normal (id 0: use the material map)
+	std::vector<Texture>		lodNormalMaps;
+	// the material is see-through (opacity below 1), it is drawn with SHADER_ALPHA in the transparent pass
+	bool						translucent;
+
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+		 std::vector<MeshLOD> lods = std::vector<MeshLOD>(), std::vector<Meshlet> meshlets = std::vector<Meshlet>(),
+		 std::vector<MeshletGroup> meshletGroups = std::vector<MeshletGroup>());
 
-	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
+	// with a cull view, LOD 0 only draws the meshlets that are in the frustum and facing the camera
+	void Draw(Shader &shader, unsigned int lod = 0, const ClusterCullView *view = NULL, ClusterCullStats *stats = NULL);
+	// positions only, no textures bound (depth and shadow passes)
+	void DrawDepth(Shader &shader, unsigned int lod = 0, const ClusterCullView *view = NULL, ClusterCullStats *stats = NULL);
+	// one draw for all instances, transforms come from the instance buffer instead of the Object block
+	void DrawInstanced(Shader &shader, const InstanceBuffer &instances, unsigned int lod = 0);
+	// returns the geometry to the pool, the mesh can't be drawn anymore
+	void Release();
 
-	void Draw(Shader &shader);
+	// the two halves of Draw, for callers that skip redundant texture binds (see render_queue.h)
+	void BindTextures(unsigned int lod);
+	void DrawGeometry(Shader &shader, bool positionsOnly, unsigned int lod, const ClusterCullView *view = NULL,
+					  ClusterCullStats *stats = NULL);
+	// false for meshes with 32-bit indices, they can't be part of a 16-bit indirect submission
+	bool IndirectDrawable() const { return indexType == GL_UNSIGNED_SHORT; }
+	// appends the draws DrawGeometry would issue as indirect commands, with their per-draw data.
+	// only for IndirectDrawable meshes
+	void AppendDraws(std::vector<DrawElementsIndirectCommand> &commands, std::vector<DrawData> &drawData,
+					 unsigned int lod, const ClusterCullView *view = NULL, ClusterCullStats *stats = NULL);
+	// layers of the diffuse, specular and normal map in their texture arrays
+	glm::vec3 MaterialLayers(unsigned int lod) const;
+	// cheapest shader permutation for drawing a LOD: the ShaderFeature bits of the maps it binds
+	// (normal, specular) or of the cheaper shading tier, and SHADER_ALPHA for translucent materials
+	unsigned int ShaderFeatures(unsigned int lod, ShadingLOD shading = SHADING_FULL) const;
+	// true if BindTextures of both would bind the same texture arrays, layers may differ
+	bool SameTextures(unsigned int lod, const Mesh &other, unsigned int otherLod) const;
+	const MeshBounds &Bounds() const { return bounds; }
+	glm::vec3 Center() const { return bounds.center; }
+	float Radius() const { return bounds.radius; }
+	// false if the bounding sphere or box is outside the frustum of the view, counted in stats
+	bool Visible(const ClusterCullView &view, ClusterCullStats *stats = NULL) const;
 
 private:
-	// render data
-	unsigned int VAO, VBO, EBO;
+	// render data: ranges in the geometry pool
+	unsigned int vertexAllocation, indexAllocation;
+	// texture unit of each texture, -1 for types no shader samples
+	std::vector<int> textureUnits;
+	// dequantization of the packed positions
+	glm::vec3 positionOffset, positionScale;
+	MeshBounds bounds;
+	// GL_UNSIGNED_SHORT when all vertices are addressable with 16 bits
+	GLenum indexType;
+	unsigned int indexSize;
+	// ranges of the visible meshlets, reused every frame
+	std::vector<GLsizei> drawCounts;
+	std::vector<unsigned int> drawFirsts;
+	std::vector<const void*> drawOffsets;
+	std::vector<GLint> drawBaseVertices;
 
 	void setupMesh();
+	void computeBounds();
+	// fills drawCounts and drawFirsts with the visible index ranges
+	void cullMeshlets(const ClusterCullView &view, ClusterCullStats *stats);
+	void drawMeshlets(const ClusterCullView &view, ClusterCullStats *stats);
 
 };
 
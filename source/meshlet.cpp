@@ -0,0 +1,164 @@
+#include "meshlet.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+void computeBounds(const std::vector<Vertex> &vertices, const unsigned int *indices, size_t indexCount,
+				   Meshlet &meshlet) {
+	// sphere around the center of the bounding box
+	glm::vec3 minimum = vertices[indices[0]].Position;
+	glm::vec3 maximum = minimum;
+	for(size_t i = 1; i < indexCount; i++) {
+		minimum = glm::min(minimum, vertices[indices[i]].Position);
+		maximum = glm::max(maximum, vertices[indices[i]].Position);
+	}
+	meshlet.center = (minimum + maximum) * 0.5f;
+	float radius = 0.0f;
+	for(size_t i = 0; i < indexCount; i++)
+		radius = std::max(radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+	meshlet.radius = radius;
+
+	// normal cone from the area weighted average of the triangle normals
+	std::vector<glm::vec3> normals;
+	glm::vec3 axis(0.0f);
+	for(size_t i = 0; i < indexCount; i += 3) {
+		glm::vec3 p0 = vertices[indices[i + 0]].Position;
+		glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+		axis += n;
+		float length = glm::length(n);
+		if(length > 0.0f)
+			normals.push_back(n / length);
+	}
+	float axisLength = glm::length(axis);
+	meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+	for(size_t i = 0; i < normals.size(); i++)
+		minDot = std::min(minDot, glm::dot(normals[i], meshlet.coneAxis));
+	// normals spreading over (almost) a hemisphere or more never face away as a whole
+	meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+}
+
+} // namespace
+
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+								   size_t maxVertices, size_t maxTriangles) {
+	std::vector<Meshlet> meshlets;
+	size_t triangleCount = indices.size() / 3;
+	if(triangleCount == 0)
+		return meshlets;
+
+	// vertex -> triangle adjacency
+	std::vector<unsigned int> offsets(vertices.size() + 1, 0);
+	for(size_t i = 0; i < indices.size(); i++)
+		offsets[indices[i] + 1]++;
+	for(size_t i = 0; i < vertices.size(); i++)
+		offsets[i + 1] += offsets[i];
+	std::vector<unsigned int> adjacency(indices.size());
+	{
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for(size_t i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<unsigned char> used(triangleCount, 0);
+	// meshlet membership of vertices, stamped with the meshlet number
+	std::vector<unsigned int> stamp(vertices.size(), 0);
+	std::vector<unsigned int> meshletVertices;
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	size_t seed = 0;
+
+	while(true) {
+		while(seed < triangleCount && used[seed])
+			seed++;
+		if(seed == triangleCount)
+			break;
+
+		unsigned int current = (unsigned int)meshlets.size() + 1;
+		Meshlet meshlet;
+		meshlet.indexOffset = (unsigned int)result.size();
+		meshletVertices.clear();
+
+		size_t triangle = seed;
+		size_t triangles = 0;
+		while(true) {
+			used[triangle] = 1;
+			triangles++;
+			for(int k = 0; k < 3; k++) {
+				unsigned int v = indices[triangle * 3 + k];
+				result.push_back(v);
+				if(stamp[v] != current) {
+					stamp[v] = current;
+					meshletVertices.push_back(v);
+				}
+			}
+			if(triangles == maxTriangles)
+				break;
+
+			// next: the unused neighbour adding the fewest new vertices
+			size_t best = triangleCount;
+			int bestNew = 4;
+			for(size_t i = 0; i < meshletVertices.size() && bestNew > 0; i++) {
+				unsigned int v = meshletVertices[i];
+				for(unsigned int a = offsets[v]; a < offsets[v + 1]; a++) {
+					unsigned int t = adjacency[a];
+					if(used[t])
+						continue;
+					int added = 0;
+					for(int k = 0; k < 3; k++)
+						added += stamp[indices[t * 3 + k]] != current;
+					if(added < bestNew) {
+						bestNew = added;
+						best = t;
+					}
+				}
+			}
+			if(best == triangleCount || meshletVertices.size() + bestNew > maxVertices)
+				break;
+			triangle = best;
+		}
+
+		meshlet.indexCount = (unsigned int)(result.size() - meshlet.indexOffset);
+		computeBounds(vertices, &result[meshlet.indexOffset], meshlet.indexCount, meshlet);
+		meshlets.push_back(meshlet);
+	}
+
+	indices.swap(result);
+	return meshlets;
+}
+
+MeshletGroup groupMeshlets(const std::vector<Meshlet> &meshlets, unsigned int meshletOffset, unsigned int meshletCount) {
+	MeshletGroup group;
+	group.meshletOffset = meshletOffset;
+	group.meshletCount = meshletCount;
+	group.indexCount = 0;
+	group.center = glm::vec3(0.0f);
+	group.radius = 0.0f;
+	if(meshletCount == 0)
+		return group;
+
+	// sphere around the bounding box of the meshlet spheres
+	glm::vec3 minimum = meshlets[meshletOffset].center - meshlets[meshletOffset].radius;
+	glm::vec3 maximum = meshlets[meshletOffset].center + meshlets[meshletOffset].radius;
+	for(unsigned int i = meshletOffset; i < meshletOffset + meshletCount; i++) {
+		minimum = glm::min(minimum, meshlets[i].center - meshlets[i].radius);
+		maximum = glm::max(maximum, meshlets[i].center + meshlets[i].radius);
+		group.indexCount += meshlets[i].indexCount;
+	}
+	group.center = (minimum + maximum) * 0.5f;
+	for(unsigned int i = meshletOffset; i < meshletOffset + meshletCount; i++)
+		group.radius = std::max(group.radius, glm::length(meshlets[i].center - group.center) + meshlets[i].radius);
+	return group;
+}
+
+bool cullMeshlet(const Meshlet &meshlet, const ClusterCullView &view) {
+	if(!sphereInFrustum(view.frustum, meshlet.center, meshlet.radius))
+		return true;
+	if(!view.backfaceCulling)
+		return false;
+	glm::vec3 toCenter = meshlet.center - view.cameraPosition;
+	return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
@@ -0,0 +1,65 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "frustum.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct Vertex;
+
+// a small cluster of triangles, stored contiguously in the mesh index buffer
+struct Meshlet {
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	// bounding sphere
+	glm::vec3 center;
+	float radius;
+	// normal cone: the whole cluster faces away from viewers with
+	// dot(center - viewer, coneAxis) >= coneCutoff * |center - viewer| + radius
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// partitions the triangles of indices into meshlets and reorders indices so every meshlet is contiguous.
+// triangles are grown from a seed across shared vertices, preferring the ones adding the fewest vertices
+std::vector<Meshlet> buildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+								   size_t maxVertices = 64, size_t maxTriangles = 124);
+
+// a contiguous run of meshlets, e.g. one source mesh of a static batch, bounded by a sphere
+// around all of them so the whole run can be rejected at once
+struct MeshletGroup {
+	unsigned int meshletOffset;
+	unsigned int meshletCount;
+	unsigned int indexCount;
+	glm::vec3 center;
+	float radius;
+};
+
+MeshletGroup groupMeshlets(const std::vector<Meshlet> &meshlets, unsigned int meshletOffset, unsigned int meshletCount);
+
+// camera data for mesh and cluster culling, in the model space of the culled mesh
+struct ClusterCullView {
+	Frustum frustum;
+	glm::vec3 cameraPosition;
+	// cone culling is only valid while back faces are invisible
+	bool backfaceCulling;
+};
+
+struct ClusterCullStats {
+	// whole meshes rejected by their bounds before any of their clusters are tested
+	size_t meshes = 0;
+	size_t meshesCulled = 0;
+	size_t groups = 0;
+	size_t groupsCulled = 0;
+	size_t meshlets = 0;
+	size_t meshletsCulled = 0;
+	size_t triangles = 0;
+	size_t trianglesCulled = 0;
+};
+
+// true if the meshlet is outside the frustum or faces away from the camera
+bool cullMeshlet(const Meshlet &meshlet, const ClusterCullView &view);
+
+#endif // MESHLET_H
@@ -1,4 +1,10 @@
 #include "model.h"
+#include "simplify.h"
+#include "quantize.h"
+#include "tangent_space.h"
+#include "geometry_pool.h"
+#include "gl_state.h"
+#include "uniform_buffer.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -7,23 +13,160 @@
 //#define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <glm/gtc/type_ptr.hpp>
+
 #include <iostream>
+#include <algorithm>
 
-Model::Model(char *path) {
+Model::Model(char *path, const ImportSettings &settings) {
+	this->settings = settings;
 	loadModel(path);
 }
 
-void Model::Draw(Shader &shader) {
+void Model::Draw(Shader &shader, unsigned int lod, const ClusterCullView *view, ClusterCullStats *stats) {
+	// all meshes draw from the VAO of the geometry pool, bound by the first one
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		if(view && !meshes[i].Visible(*view, stats))
+			continue;
+		meshes[i].Draw(shader, lod, view, stats);
+	}
+	geometryPool().Unbind();
+}
+
+void Model::DrawDepth(Shader &shader, unsigned int lod, const ClusterCullView *view, ClusterCullStats *stats) {
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		if(view && !meshes[i].Visible(*view, stats))
+			continue;
+		meshes[i].DrawDepth(shader, lod, view, stats);
+	}
+	geometryPool().Unbind();
+}
+
+void Model::DrawInstanced(ShaderPermutations &shaders, unsigned int features, const InstanceBuffer &instances,
+						  unsigned int lod) {
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		Shader &shader = shaders.Get(features | SHADER_INSTANCED | meshes[i].ShaderFeatures(lod));
+		shader.use();
+		meshes[i].DrawInstanced(shader, instances, lod);
+	}
+	geometryPool().Unbind();
+}
+
+void Model::Submit(RenderQueue &queue, ShaderPermutations &shaders, unsigned int features, RenderPass pass,
+				   unsigned int lod, unsigned int object, const ClusterCullView &view, ClusterCullStats *stats,
+				   const ShadingLODView *shading, ShadingLODStats *shadingStats) {
+	submit(queue, shaders, features, pass, lod, object, view, stats, shading, shadingStats, false);
+}
+
+void Model::SubmitTranslucent(RenderQueue &queue, ShaderPermutations &shaders, unsigned int features,
+							  unsigned int lod, unsigned int object, const ClusterCullView &view,
+							  ClusterCullStats *stats, const ShadingLODView *shading, ShadingLODStats *shadingStats) {
+	submit(queue, shaders, features, PASS_TRANSPARENT, lod, object, view, stats, shading, shadingStats, true);
+}
+
+void Model::submit(RenderQueue &queue, ShaderPermutations &shaders, unsigned int features, RenderPass pass,
+				   unsigned int lod, unsigned int object, const ClusterCullView &view, ClusterCullStats *stats,
+				   const ShadingLODView *shading, ShadingLODStats *shadingStats, bool translucentOnly) {
+	RenderItem item;
+	item.lod = lod;
+	item.object = object;
+	item.view = &view;
+	item.stats = stats;
 	for(unsigned int i = 0; i < meshes.size(); i++) {
-		meshes[i].Draw(shader);
+		// translucent meshes neither occlude nor blend correctly unless sorted back to front
+		if(meshes[i].translucent ? pass == PASS_DEPTH : translucentOnly)
+			continue;
+		// meshes outside the frustum are not queued, whatever their LOD
+		if(!meshes[i].Visible(view, stats))
+			continue;
+		item.mesh = &meshes[i];
+		item.pass = meshes[i].translucent ? PASS_TRANSPARENT : pass;
+		// depth only draws sample no textures
+		if(pass == PASS_DEPTH) {
+			item.shader = &shaders.Get(features);
+		}
+		else {
+			ShadingLOD tier = shading ? SelectShadingLOD(meshes[i], lod, *shading) : SHADING_FULL;
+			item.shader = &shaders.Get(features | meshes[i].ShaderFeatures(lod, tier));
+			if(shadingStats)
+				shadingStats->draws[tier]++;
+		}
+		// distance in model space, the queue only compares items
+		queue.Submit(item, glm::length(meshes[i].Center() - view.cameraPosition));
 	}
 }
 
+bool Model::IndirectDrawable() const {
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		if(!meshes[i].IndirectDrawable())
+			return false;
+	}
+	return true;
+}
+
+void Model::Submit(IndirectDrawBuffer &buffer, unsigned int lod, const ClusterCullView *view,
+				   ClusterCullStats *stats, const ShadingLODView *shading, ShadingLODStats *shadingStats) {
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		if(meshes[i].translucent || (view && !meshes[i].Visible(*view, stats)))
+			continue;
+		ShadingLOD tier = shading ? SelectShadingLOD(meshes[i], lod, *shading) : SHADING_FULL;
+		buffer.Add(meshes[i], lod, view, stats, tier);
+		if(shadingStats)
+			shadingStats->draws[tier]++;
+	}
+}
+
+void Model::PrepareShaders(ShaderPermutations &shaders, unsigned int features) const {
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		for(unsigned int lod = 0; lod < meshes[i].lods.size(); lod++) {
+			for(int tier = 0; tier < SHADING_LODS; tier++)
+				shaders.Prepare(features | meshes[i].ShaderFeatures(lod, (ShadingLOD)tier));
+		}
+	}
+}
+
+void Model::Release() {
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		meshes[i].Release();
+	}
+	meshes.clear();
+}
+
+unsigned int Model::SelectLOD(float distance, float pixelScale, float maxPixelError) const {
+	unsigned int lod = 0;
+	distance = std::max(distance, 1e-4f);
+	for(unsigned int i = 1; i < lodErrors.size(); i++) {
+		if(lodErrors[i] * pixelScale / distance <= maxPixelError)
+			lod = i;
+	}
+	return lod;
+}
+
+ShadingLOD Model::SelectShadingLOD(const Mesh &mesh, unsigned int lod, const ShadingLODView &view) {
+	// coarse geometry comes with cheap shading, whatever its size on screen
+	int tier = SHADING_FULL;
+	if(lod >= view.vertexLOD)
+		tier = SHADING_VERTEX;
+	else if(lod >= view.simpleLOD)
+		tier = SHADING_SIMPLE;
+
+	// projected radius of the bounding sphere, only the geometry LOD counts while the camera is inside it
+	float distance = glm::length(mesh.Center() - view.cameraPosition);
+	if(distance <= mesh.Radius())
+		return (ShadingLOD)tier;
+	float radius = mesh.Radius() * view.pixelScale / distance;
+	if(radius < view.vertexRadius)
+		tier = SHADING_VERTEX;
+	else if(radius < view.simpleRadius)
+		tier = std::max(tier, (int)SHADING_SIMPLE);
+	return (ShadingLOD)tier;
+}
+
 void Model::loadModel(std::string path) {
 	Assimp::Importer import;
-	// important flag: aiProcess_CalcTangentSpace to generate fragment tangents needed for proper normal mapping
+	// tangents for normal mapping are generated in processMesh, assimp only fills in missing normals
 	const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs |
-	aiProcess_CalcTangentSpace);
+	aiProcess_GenSmoothNormals);
 
 	if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 		std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
@@ -32,41 +175,83 @@ void Model::loadModel(std::string path) {
 
 	directory = path.substr(0, path.find_last_of('/'));
 
-	processNode(scene->mRootNode, scene);
+	// nodes driven by an animation channel, their meshes are not batched
+	std::set<std::string> animatedNodes;
+	for(unsigned int i = 0; i < scene->mNumAnimations; i++) {
+		const aiAnimation* animation = scene->mAnimations[i];
+		for(unsigned int j = 0; j < animation->mNumChannels; j++)
+			animatedNodes.insert(animation->mChannels[j]->mNodeName.C_Str());
+	}
+
+	std::vector<SourceMesh> sources;
+	processNode(scene->mRootNode, scene, glm::mat4(1.0f), false, animatedNodes, sources);
+	buildBatches(sources, scene);
+	bakeDetailMaps.clear();
+	buildTextureArrays();
+	materialBuffer().Upload();
+
+	GeometryPoolStats poolStats = geometryPool().Stats();
+	std::cout << "geometry pool: " << poolStats.verticesUsed << "/" << poolStats.vertexCapacity << " vertices, "
+			  << poolStats.indexBytesUsed << "/" << poolStats.indexCapacity << " index bytes, "
+			  << poolStats.freeBlocks << " free blocks, fragmentation " << (int)(100 * poolStats.vertexFragmentation)
+			  << "% / " << (int)(100 * poolStats.indexFragmentation) << "%" << std::endl;
+
+	// meshes with a shorter LOD chain draw their coarsest level in place of the missing ones
+	lodErrors.clear();
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		const std::vector<MeshLOD> &lods = meshes[i].lods;
+		if(lods.size() > lodErrors.size())
+			lodErrors.resize(lods.size(), 0.0f);
+	}
+	for(unsigned int level = 0; level < lodErrors.size(); level++) {
+		for(unsigned int i = 0; i < meshes.size(); i++) {
+			const std::vector<MeshLOD> &lods = meshes[i].lods;
+			lodErrors[level] = std::max(lodErrors[level], lods[std::min<size_t>(level, lods.size() - 1)].error);
+		}
+	}
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
+void Model::processNode(aiNode *node, const aiScene *scene, const glm::mat4 &parentTransform, bool parentAnimated,
+						const std::set<std::string> &animatedNodes, std::vector<SourceMesh> &sources) {
+	// assimp matrices are row major
+	glm::mat4 transform = parentTransform * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+	bool animated = parentAnimated || animatedNodes.count(node->mName.C_Str()) > 0;
 	// process all the node's meshes (if any)
 	for(unsigned int i = 0; i < node->mNumMeshes; i++) {
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		sources.push_back(processMesh(mesh, transform));
+		sources.back().animated = animated || mesh->HasBones();
 	}
 	// then do the same for each of its children
 	for(unsigned int i = 0; i < node->mNumChildren; i++) {
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, transform, animated, animatedNodes, sources);
 	}
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
-	std::vector<Texture> textures;
+SourceMesh Model::processMesh(aiMesh *mesh, const glm::mat4 &transform) {
+	SourceMesh source;
+	std::vector<Vertex> &vertices = source.vertices;
+	std::vector<unsigned int> &indices = source.indices;
+	source.materialIndex = mesh->mMaterialIndex;
+	source.animated = false;
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
 
 	for(unsigned int i = 0; i < mesh->mNumVertices; i++) {
 		Vertex vertex;
-		// process vertex positions, normals and texture coordinates:
+		vertex.Tangent = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);	// generated below
+		// process vertex positions, normals and texture coordinates (baking in the node transform):
 		// positions
 		glm::vec3 vector;	// placeholder since assimp uses own vector class
 		vector.x = mesh->mVertices[i].x;
 		vector.y = mesh->mVertices[i].y;
 		vector.z = mesh->mVertices[i].z;
-		vertex.Position = vector;
+		vertex.Position = glm::vec3(transform * glm::vec4(vector, 1.0f));
 		// normals
 		if(mesh->HasNormals()) {
 			vector.x = mesh->mNormals[i].x;
 			vector.y = mesh->mNormals[i].y;
 			vector.z = mesh->mNormals[i].z;
-			vertex.Normal = vector;
+			vertex.Normal = glm::normalize(normalMatrix * vector);
 		}
 		// texture coordinates
 		if(mesh->mTextureCoords[0]) {	// check if it has coords
@@ -75,11 +260,6 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
 			vec.x = mesh->mTextureCoords[0][i].x;
 			vec.y = mesh->mTextureCoords[0][i].y;
 			vertex.TexCoord = vec;
-			// tangent
-			vector.x = mesh->mTangents[i].x;
-			vector.y = mesh->mTangents[i].y;
-			vector.z = mesh->mTangents[i].y;
-			vertex.Tangent = vector;
 		}
 		else {
 			vertex.TexCoord = glm::vec2(0.0f, 0.0f);
@@ -94,21 +274,175 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
 			indices.push_back(face.mIndices[j]);
 		}
 	}
-	// process material
-	if(mesh->mMaterialIndex >= 0) {
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-		std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
-													 aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		std::vector<Texture> specularMaps = loadMaterialTextures(material,
-																aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		std::vector<Texture> normalMaps = loadMaterialTextures(material,
-														 aiTextureType_HEIGHT, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+	// mirroring transforms flip the winding
+	if(glm::determinant(glm::mat3(transform)) < 0.0f) {
+		for(size_t i = 0; i + 2 < indices.size(); i += 3)
+			std::swap(indices[i + 1], indices[i + 2]);
+	}
+
+	// tangent frames (MikkTSpace compatible), may duplicate vertices with mirrored UVs
+	generateTangents(vertices, indices);
+
+	// merge the duplicated vertices of unwelded imports (OBJ stores every face corner separately)
+	size_t unweldedCount = vertices.size();
+	weldVertices(vertices, indices, settings.weld);
+	if(unweldedCount > 0) {
+		std::cout << "welded mesh " << mesh->mName.C_Str() << ": " << unweldedCount << " -> " << vertices.size()
+				  << " vertices (" << 100 * (unweldedCount - vertices.size()) / unweldedCount << "% removed)" << std::endl;
+	}
+	return source;
+}
+
+void Model::buildBatches(std::vector<SourceMesh> &sources, const aiScene *scene) {
+	size_t sourceCount = sources.size();
+	// meshes too large for 16-bit indices are split first, each part is batched on its own
+	std::vector<SourceMesh> parts;
+	for(unsigned int i = 0; i < sources.size(); i++) {
+		std::vector<MeshChunk> chunks = splitMesh(sources[i].vertices, sources[i].indices);
+		for(unsigned int j = 0; j < chunks.size(); j++) {
+			parts.push_back(SourceMesh());
+			parts.back().vertices.swap(chunks[j].vertices);
+			parts.back().indices.swap(chunks[j].indices);
+			parts.back().materialIndex = sources[i].materialIndex;
+			parts.back().animated = sources[i].animated;
+		}
+	}
+	sources.clear();
+
+	// scalar parameters of every material go to the shared material table
+	std::vector<unsigned int> materialIndices;
+	for(unsigned int i = 0; i < scene->mNumMaterials; i++)
+		materialIndices.push_back(loadMaterialParameters(scene->mMaterials[i]));
+
+	// static parts sharing a material are merged into one vertex and index buffer as long as
+	// 16-bit indices suffice. every part stays a separate group of meshlets for culling
+	std::vector<bool> batched(parts.size(), false);
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<unsigned int> ranges;
+	for(unsigned int i = 0; i < parts.size(); i++) {
+		if(batched[i])
+			continue;
+		vertices.clear();
+		indices.clear();
+		ranges.clear();
+		for(unsigned int j = i; j < parts.size(); j++) {
+			SourceMesh &part = parts[j];
+			if(batched[j] || part.materialIndex != parts[i].materialIndex)
+				continue;
+			if(j != i && (!settings.staticBatching || part.animated || parts[i].animated))
+				continue;
+			// parts that do not fit anymore start the next batch of this material
+			if(vertices.size() + part.vertices.size() > 65536)
+				continue;
+			batched[j] = true;
+			ranges.push_back(indices.size());
+			unsigned int base = vertices.size();
+			for(unsigned int k = 0; k < part.indices.size(); k++)
+				indices.push_back(part.indices[k] + base);
+			vertices.insert(vertices.end(), part.vertices.begin(), part.vertices.end());
+			std::vector<Vertex>().swap(part.vertices);
+			std::vector<unsigned int>().swap(part.indices);
+		}
+		createMesh(vertices, indices, ranges, loadMaterial(scene->mMaterials[parts[i].materialIndex]));
+		meshes.back().materialIndex = materialIndices[parts[i].materialIndex];
+		meshes.back().translucent = materialBuffer().Get(meshes.back().materialIndex).diffuse.a < 1.0f;
+	}
+	std::cout << "batched " << sourceCount << " meshes into " << meshes.size() << " draw batches" << std::endl;
+}
+
+void Model::createMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+					   const std::vector<unsigned int> &ranges, const std::vector<Texture> &textures) {
+	// ranges holds the first index of every source mesh. meshlets are built per range so each
+	// range becomes a contiguous meshlet group, then the LOD chain of the whole batch is appended
+	std::vector<unsigned int> ordered;
+	ordered.reserve(indices.size());
+	std::vector<Meshlet> meshlets;
+	std::vector<MeshletGroup> groups;
+	for(unsigned int r = 0; r < ranges.size(); r++) {
+		size_t end = r + 1 < ranges.size() ? ranges[r + 1] : indices.size();
+		if(end == ranges[r])
+			continue;
+		std::vector<unsigned int> range(indices.begin() + ranges[r], indices.begin() + end);
+		std::vector<Meshlet> rangeMeshlets = buildMeshlets(vertices, range);
+		unsigned int first = meshlets.size();
+		for(unsigned int i = 0; i < rangeMeshlets.size(); i++) {
+			rangeMeshlets[i].indexOffset += ordered.size();
+			meshlets.push_back(rangeMeshlets[i]);
+		}
+		ordered.insert(ordered.end(), range.begin(), range.end());
+		groups.push_back(groupMeshlets(meshlets, first, rangeMeshlets.size()));
+	}
+
+	std::vector<MeshLOD> lods = generateLODChain(vertices, ordered, settings.lodRatios);
+	meshes.push_back(Mesh(vertices, ordered, textures, lods, meshlets, groups));
+	if(settings.bakeNormalMaps)
+		bakeLODNormalMaps(meshes.back());
+}
+
+std::vector<Texture> Model::loadMaterial(aiMaterial *material) {
+	std::vector<Texture> textures;
+	std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
+												 aiTextureType_DIFFUSE, "texture_diffuse");
+	textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+	std::vector<Texture> specularMaps = loadMaterialTextures(material,
+															aiTextureType_SPECULAR, "texture_specular");
+	textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+	std::vector<Texture> normalMaps = loadMaterialTextures(material,
+													 aiTextureType_HEIGHT, "texture_normal");
+	textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+	return textures;
+}
+
+unsigned int Model::loadMaterialParameters(aiMaterial *material) {
+	// values the material does not define keep the former fixed shading (white, shininess 32)
+	aiColor3D diffuse(1.0f, 1.0f, 1.0f), specular(1.0f, 1.0f, 1.0f);
+	float opacity = 1.0f, shininess = 32.0f;
+	material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+	material->Get(AI_MATKEY_COLOR_SPECULAR, specular);
+	material->Get(AI_MATKEY_OPACITY, opacity);
+	material->Get(AI_MATKEY_SHININESS, shininess);
+	// exporters write the untextured base color as Kd, a diffuse map replaces it
+	if(material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+		diffuse = aiColor3D(1.0f, 1.0f, 1.0f);
+
+	MaterialUniforms parameters;
+	parameters.diffuse = glm::vec4(diffuse.r, diffuse.g, diffuse.b, opacity);
+	// Ns 0 would turn every fragment into a highlight
+	parameters.specular = glm::vec4(specular.r, specular.g, specular.b, std::max(shininess, 1.0f));
+	return materialBuffer().Add(parameters);
+}
+
+void Model::bakeLODNormalMaps(Mesh &mesh) {
+	// the material normal map adds its detail to the baked high surface
+	const BakeImage *detail = NULL;
+	for(unsigned int i = 0; i < mesh.textures.size(); i++) {
+		if(mesh.textures[i].type != "texture_normal")
+			continue;
+		std::map<std::string, BakeImage>::iterator it = bakeDetailMaps.find(mesh.textures[i].path);
+		if(it == bakeDetailMaps.end()) {
+			BakeImage image;
+			std::string filename = directory + '/' + mesh.textures[i].path;
+			unsigned char* data = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0);
+			if(data) {
+				image.pixels.assign(data, data + (size_t)image.width * image.height * image.components);
+				stbi_image_free(data);
+			}
+			it = bakeDetailMaps.insert(std::make_pair(mesh.textures[i].path, image)).first;
+		}
+		if(!it->second.pixels.empty())
+			detail = &it->second;
+		break;
 	}
 
-	return Mesh(vertices, indices, textures);
+	BakeMesh high = { &mesh.vertices, &mesh.indices[mesh.lods[0].indexOffset], mesh.lods[0].indexCount };
+	Texture none = { 0, "texture_normal", "", 0 };
+	mesh.lodNormalMaps.assign(mesh.lods.size(), none);
+	for(unsigned int lod = 1; lod < mesh.lods.size(); lod++) {
+		BakeMesh low = { &mesh.vertices, &mesh.indices[mesh.lods[lod].indexOffset], mesh.lods[lod].indexCount };
+		mesh.lodNormalMaps[lod].id = TextureFromImage(bakeNormalMap(high, low, detail, settings.bake));
+	}
+	std::cout << "baked normal maps for " << mesh.lods.size() - 1 << " LODs" << std::endl;
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName) {
@@ -129,6 +463,7 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType
 			// if the texture hasn't been loaded yet
 			Texture texture;
 			texture.id = TextureFromFile(str.C_Str(), directory);
+			texture.layer = 0;
 			texture.type = typeName;
 			texture.path = str.C_Str();
 			textures.push_back(texture);
@@ -138,44 +473,47 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType
 	return textures;
 }
 
+unsigned int Model::TextureFromImage(const BakeImage &image) {
+	return textureArrays.Add(&image.pixels[0], image.width, image.height);
+}
+
 unsigned int Model::TextureFromFile(const char *path, const std::string &directory) {
 	std::string filename = std::string(path);
 	filename = directory + '/' + filename;
 
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
+	// every texture is expanded to RGBA8 so all images of a size fit into one array
 	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if(data) {
-		GLenum format;
-		if(nrComponents == 1) {
-			format = GL_LUMINANCE16;
-		}
-		else if(nrComponents == 3) {
-			format = GL_RGB;
+	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 4);
+	if(!data) {
+		std::cout << "Texture failed to load at path: " << path << std::endl;
+		// black, like sampling a texture without an image
+		const unsigned char black[4] = { 0, 0, 0, 255 };
+		return textureArrays.Add(black, 1, 1);
+	}
+	unsigned int handle = textureArrays.Add(data, width, height);
+	std::cout << "loaded texture: " << filename << std::endl;
+	stbi_image_free(data);
+	return handle;
+}
+
+void Model::buildTextureArrays() {
+	textureArrays.Build();
+	// image handles become texture arrays and layers
+	for(unsigned int i = 0; i < meshes.size(); i++) {
+		Mesh &mesh = meshes[i];
+		for(unsigned int j = 0; j < mesh.textures.size(); j++) {
+			mesh.textures[j].layer = textureArrays.Layer(mesh.textures[j].id);
+			mesh.textures[j].id = textureArrays.Array(mesh.textures[j].id);
 		}
-		else if(nrComponents == 4) {
-			format = GL_RGBA;
+		for(unsigned int j = 0; j < mesh.lodNormalMaps.size(); j++) {
+			mesh.lodNormalMaps[j].layer = textureArrays.Layer(mesh.lodNormalMaps[j].id);
+			mesh.lodNormalMaps[j].id = textureArrays.Array(mesh.lodNormalMaps[j].id);
 		}
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		std::cout << "loaded texture: " << filename << std::endl;
-
-		stbi_image_free(data);
 	}
-	else {
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+	for(unsigned int i = 0; i < textures_loaded.size(); i++) {
+		textures_loaded[i].layer = textureArrays.Layer(textures_loaded[i].id);
+		textures_loaded[i].id = textureArrays.Array(textures_loaded[i].id);
 	}
-
-	return textureID;
-}
\ No newline at end of file
+	std::cout << "packed " << textureArrays.ImageCount() << " textures into " << textureArrays.ArrayCount()
+			  << " texture arrays" << std::endl;
+}
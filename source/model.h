@@ -5,23 +5,119 @@
 
 #include "shader.h"
 #include "mesh.h"
+#include "weld.h"
+#include "normal_baker.h"
+#include "render_queue.h"
+#include "texture_array.h"
+
+#include <map>
+#include <set>
+
+// mesh processing applied at import
+struct ImportSettings {
+	// triangle ratios of the generated LOD levels, relative to the full detail mesh
+	std::vector<float> lodRatios = std::vector<float>{0.5f, 0.25f, 0.1f};
+	WeldOptions weld;
+	// bake the full detail surface into a normal map for every coarser LOD
+	bool bakeNormalMaps = false;
+	BakeSettings bake;
+	// merge static meshes sharing a material into one buffer (node transforms baked in)
+	bool staticBatching = true;
+};
+
+// per-frame input of the shading LOD selection: a draw gets the cheapest tier its projected size
+// allows, and at least the tier its geometry LOD comes with
+struct ShadingLODView {
+	glm::vec3 cameraPosition;	// model space
+	// viewport height divided by 2 * tan(fovy / 2), as for SelectLOD
+	float pixelScale;
+	// projected bounding sphere radius in pixels below which the tier applies
+	float simpleRadius;
+	float vertexRadius;
+	// first geometry LOD of the tier
+	unsigned int simpleLOD;
+	unsigned int vertexLOD;
+};
+
+struct ShadingLODStats {
+	size_t draws[SHADING_LODS] = {0, 0, 0};
+};
+
+// geometry of one assimp mesh in model space, waiting to be batched
+struct SourceMesh {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	unsigned int materialIndex;
+	// animated and skinned meshes keep their own buffers so they can move independently
+	bool animated;
+};
 
 class Model {
 public:
 	std::vector<Texture> textures_loaded;
+	// largest error of all meshes per LOD level
+	std::vector<float> lodErrors;
 
-	Model(char *path);
-	void Draw(Shader &shader);
+	Model(char *path, const ImportSettings &settings = ImportSettings());
+	void Draw(Shader &shader, unsigned int lod = 0, const ClusterCullView *view = NULL, ClusterCullStats *stats = NULL);
+	void DrawDepth(Shader &shader, unsigned int lod = 0, const ClusterCullView *view = NULL, ClusterCullStats *stats = NULL);
+	// draws every instance of the buffer with one draw call per mesh, each with its SHADER_INSTANCED permutation
+	void DrawInstanced(ShaderPermutations &shaders, unsigned int features, const InstanceBuffer &instances,
+					   unsigned int lod = 0);
+	// queues one item per mesh instead of drawing, object is the model's ObjectUniformBuffer index. every
+	// mesh is drawn with the permutation of features and its own (see Mesh::ShaderFeatures) at the tier
+	// shading selects, full shading without it. the depth pass uses features only. translucent meshes
+	// always go to the transparent pass and are left out of the depth pass
+	void Submit(RenderQueue &queue, ShaderPermutations &shaders, unsigned int features, RenderPass pass,
+				unsigned int lod, unsigned int object, const ClusterCullView &view, ClusterCullStats *stats = NULL,
+				const ShadingLODView *shading = NULL, ShadingLODStats *shadingStats = NULL);
+	// queues the translucent meshes only, for the transparent pass after the indirect draws
+	void SubmitTranslucent(RenderQueue &queue, ShaderPermutations &shaders, unsigned int features, unsigned int lod,
+						   unsigned int object, const ClusterCullView &view, ClusterCullStats *stats = NULL,
+						   const ShadingLODView *shading = NULL, ShadingLODStats *shadingStats = NULL);
+	// true if every mesh can be drawn indirectly, decides once whether the model uses the indirect path
+	bool IndirectDrawable() const;
+	// appends the draws of all opaque meshes as indirect commands, only for IndirectDrawable models.
+	// translucent ones need the sorted transparent pass, see SubmitTranslucent
+	void Submit(IndirectDrawBuffer &buffer, unsigned int lod, const ClusterCullView *view = NULL,
+				ClusterCullStats *stats = NULL, const ShadingLODView *shading = NULL,
+				ShadingLODStats *shadingStats = NULL);
+	// starts building the permutations of features the meshes need at any LOD
+	void PrepareShaders(ShaderPermutations &shaders, unsigned int features) const;
+	size_t MeshCount() const { return meshes.size(); }
+	// returns the geometry of all meshes to the geometry pool
+	void Release();
+	// coarsest LOD whose error projected to the screen stays below maxPixelError.
+	// pixelScale is the viewport height divided by 2 * tan(fovy / 2)
+	unsigned int SelectLOD(float distance, float pixelScale, float maxPixelError) const;
+	static ShadingLOD SelectShadingLOD(const Mesh &mesh, unsigned int lod, const ShadingLODView &view);
 
 private:
 	std::vector<Mesh> meshes;
 	std::string directory;
+	ImportSettings settings;
+	// decoded material normal maps used as baking detail, only kept while loading
+	std::map<std::string, BakeImage> bakeDetailMaps;
+	// material and baked textures, texture ids are handles into it until buildTextureArrays
+	TextureArrayBuilder textureArrays;
 
+	void submit(RenderQueue &queue, ShaderPermutations &shaders, unsigned int features, RenderPass pass,
+				unsigned int lod, unsigned int object, const ClusterCullView &view, ClusterCullStats *stats,
+				const ShadingLODView *shading, ShadingLODStats *shadingStats, bool translucentOnly);
 	void loadModel(std::string path);
-	void processNode(aiNode* node, const aiScene* scene);
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+	void processNode(aiNode* node, const aiScene* scene, const glm::mat4 &parentTransform, bool parentAnimated,
+					 const std::set<std::string> &animatedNodes, std::vector<SourceMesh> &sources);
+	SourceMesh processMesh(aiMesh* mesh, const glm::mat4 &transform);
+	void buildBatches(std::vector<SourceMesh> &sources, const aiScene* scene);
+	void createMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+					const std::vector<unsigned int> &ranges, const std::vector<Texture> &textures);
+	std::vector<Texture> loadMaterial(aiMaterial* material);
+	unsigned int loadMaterialParameters(aiMaterial* material);
 	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
 	unsigned int TextureFromFile(const char* path, const std::string &directory);
+	unsigned int TextureFromImage(const BakeImage &image);
+	void bakeLODNormalMaps(Mesh &mesh);
+	void buildTextureArrays();
 };
 
 
@@ -0,0 +1,379 @@
+#include "normal_baker.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct Triangle {
+	glm::vec3 p0, e1, e2;
+};
+
+struct BVHNode {
+	glm::vec3 minimum;
+	unsigned int leftOrFirst;	// first child for inner nodes, first triangle for leaves
+	glm::vec3 maximum;
+	unsigned int count;			// triangles in a leaf, 0 for inner nodes
+};
+
+struct Hit {
+	float t;
+	unsigned int triangle;
+	float u, v;		// barycentrics of the second and third corner
+};
+
+// bounding volume hierarchy over a triangle list, median split on the longest centroid axis
+class BVH {
+public:
+	std::vector<Triangle> triangles;	// in BVH order
+	std::vector<unsigned int> order;	// BVH order -> source triangle
+	std::vector<BVHNode> nodes;
+
+	explicit BVH(const BakeMesh &mesh) {
+		const std::vector<Vertex> &vertices = *mesh.vertices;
+		size_t count = mesh.indexCount / 3;
+		std::vector<glm::vec3> centroids(count);
+		order.resize(count);
+		for(size_t i = 0; i < count; i++) {
+			order[i] = (unsigned int)i;
+			centroids[i] = (vertices[mesh.indices[i * 3 + 0]].Position + vertices[mesh.indices[i * 3 + 1]].Position +
+							vertices[mesh.indices[i * 3 + 2]].Position) / 3.0f;
+		}
+		nodes.reserve(count * 2);
+		nodes.push_back(BVHNode());
+		if(count > 0)
+			build(mesh, centroids, 0, 0, (unsigned int)count);
+
+		triangles.resize(count);
+		for(size_t i = 0; i < count; i++) {
+			const unsigned int *tri = &mesh.indices[order[i] * 3];
+			triangles[i].p0 = vertices[tri[0]].Position;
+			triangles[i].e1 = vertices[tri[1]].Position - triangles[i].p0;
+			triangles[i].e2 = vertices[tri[2]].Position - triangles[i].p0;
+		}
+	}
+
+	// closest hit with t in (0, tMax]
+	bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, Hit &hit) const {
+		return traverse(origin, direction, tMax, &hit);
+	}
+
+	// any hit with t in (0, tMax]
+	bool occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const {
+		return traverse(origin, direction, tMax, NULL);
+	}
+
+private:
+	static const unsigned int LEAF_SIZE = 4;
+
+	void build(const BakeMesh &mesh, const std::vector<glm::vec3> &centroids, size_t nodeIndex,
+			   unsigned int first, unsigned int count) {
+		const std::vector<Vertex> &vertices = *mesh.vertices;
+		glm::vec3 minimum(1e30f), maximum(-1e30f);
+		glm::vec3 centroidMin(1e30f), centroidMax(-1e30f);
+		for(unsigned int i = first; i < first + count; i++) {
+			for(int k = 0; k < 3; k++) {
+				const glm::vec3 &p = vertices[mesh.indices[order[i] * 3 + k]].Position;
+				minimum = glm::min(minimum, p);
+				maximum = glm::max(maximum, p);
+			}
+			centroidMin = glm::min(centroidMin, centroids[order[i]]);
+			centroidMax = glm::max(centroidMax, centroids[order[i]]);
+		}
+		nodes[nodeIndex].minimum = minimum;
+		nodes[nodeIndex].maximum = maximum;
+
+		glm::vec3 extent = centroidMax - centroidMin;
+		if(count <= LEAF_SIZE || glm::max(extent.x, glm::max(extent.y, extent.z)) <= 0.0f) {
+			nodes[nodeIndex].leftOrFirst = first;
+			nodes[nodeIndex].count = count;
+			return;
+		}
+
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		unsigned int half = count / 2;
+		std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+						 [&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+		unsigned int left = (unsigned int)nodes.size();
+		nodes.push_back(BVHNode());
+		nodes.push_back(BVHNode());
+		nodes[nodeIndex].leftOrFirst = left;
+		nodes[nodeIndex].count = 0;
+		build(mesh, centroids, left, first, half);
+		build(mesh, centroids, left + 1, first + half, count - half);
+	}
+
+	static bool intersectBox(const BVHNode &node, const glm::vec3 &origin, const glm::vec3 &invDirection, float tMax) {
+		glm::vec3 t0 = (node.minimum - origin) * invDirection;
+		glm::vec3 t1 = (node.maximum - origin) * invDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+		float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+		return enter <= exit;
+	}
+
+	// Moeller-Trumbore, two sided
+	static bool intersectTriangle(const Triangle &tri, const glm::vec3 &origin, const glm::vec3 &direction,
+								  float &t, float &u, float &v) {
+		glm::vec3 p = glm::cross(direction, tri.e2);
+		float det = glm::dot(tri.e1, p);
+		if(std::fabs(det) < 1e-12f)
+			return false;
+		float invDet = 1.0f / det;
+		glm::vec3 s = origin - tri.p0;
+		u = glm::dot(s, p) * invDet;
+		if(u < 0.0f || u > 1.0f)
+			return false;
+		glm::vec3 q = glm::cross(s, tri.e1);
+		v = glm::dot(direction, q) * invDet;
+		if(v < 0.0f || u + v > 1.0f)
+			return false;
+		t = glm::dot(tri.e2, q) * invDet;
+		return t > 0.0f;
+	}
+
+	bool traverse(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, Hit *hit) const {
+		if(triangles.empty())
+			return false;
+		glm::vec3 invDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		unsigned int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		bool found = false;
+		while(top > 0) {
+			const BVHNode &node = nodes[stack[--top]];
+			if(!intersectBox(node, origin, invDirection, tMax))
+				continue;
+			if(node.count == 0) {
+				stack[top++] = node.leftOrFirst;
+				stack[top++] = node.leftOrFirst + 1;
+				continue;
+			}
+			for(unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+				float t, u, v;
+				if(!intersectTriangle(triangles[i], origin, direction, t, u, v) || t > tMax)
+					continue;
+				if(!hit)
+					return true;
+				tMax = t;
+				hit->t = t;
+				hit->triangle = order[i];
+				hit->u = u;
+				hit->v = v;
+				found = true;
+			}
+		}
+		return found;
+	}
+};
+
+glm::vec3 safeNormalize(const glm::vec3 &v, const glm::vec3 &fallback) {
+	float length = glm::length(v);
+	return length > 1e-20f ? v / length : fallback;
+}
+
+// nearest texel lookup of a tangent space normal, UVs repeat
+glm::vec3 sampleNormal(const BakeImage &image, const glm::vec2 &uv) {
+	float u = uv.x - std::floor(uv.x);
+	float v = uv.y - std::floor(uv.y);
+	int x = std::min((int)(u * image.width), image.width - 1);
+	int y = std::min((int)(v * image.height), image.height - 1);
+	const unsigned char *texel = &image.pixels[((size_t)y * image.width + x) * image.components];
+	if(image.components < 3)
+		return glm::vec3(0.0f, 0.0f, 1.0f);
+	return glm::normalize(glm::vec3(texel[0], texel[1], texel[2]) / 127.5f - 1.0f);
+}
+
+// texel of the output image covered by a low mesh triangle
+struct TexelSample {
+	unsigned int triangle;	// ~0u if not covered
+	float b1, b2;
+};
+
+unsigned int hash(unsigned int x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+} // namespace
+
+BakeImage bakeNormalMap(const BakeMesh &high, const BakeMesh &low, const BakeImage *detail,
+						const BakeSettings &settings) {
+	const int size = settings.resolution;
+	BakeImage image;
+	image.width = size;
+	image.height = size;
+	image.components = 4;
+	image.pixels.assign((size_t)size * size * 4, 0);
+
+	BVH bvh(high);
+	glm::vec3 minimum(1e30f), maximum(-1e30f);
+	for(size_t i = 0; i < high.indexCount; i++) {
+		minimum = glm::min(minimum, (*high.vertices)[high.indices[i]].Position);
+		maximum = glm::max(maximum, (*high.vertices)[high.indices[i]].Position);
+	}
+	float diagonal = high.indexCount > 0 ? glm::length(maximum - minimum) : 1.0f;
+	float searchDistance = settings.maxDistance * diagonal;
+	float aoDistance = settings.aoDistance * diagonal;
+
+	// 1. rasterize the low mesh in UV space (texel centers)
+	std::vector<TexelSample> samples((size_t)size * size);
+	for(size_t i = 0; i < samples.size(); i++)
+		samples[i].triangle = ~0u;
+	const std::vector<Vertex> &lowVertices = *low.vertices;
+	for(size_t t = 0; t < low.indexCount / 3; t++) {
+		glm::vec2 uv[3];
+		for(int k = 0; k < 3; k++)
+			uv[k] = lowVertices[low.indices[t * 3 + k]].TexCoord;
+		// move repeating UVs into the unit square
+		glm::vec2 shift = glm::floor(glm::min(uv[0], glm::min(uv[1], uv[2])));
+		for(int k = 0; k < 3; k++)
+			uv[k] = (uv[k] - shift) * (float)size;
+		float area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y);
+		if(std::fabs(area) < 1e-12f)
+			continue;
+		glm::vec2 lo = glm::min(uv[0], glm::min(uv[1], uv[2]));
+		glm::vec2 hi = glm::max(uv[0], glm::max(uv[1], uv[2]));
+		int x0 = std::max(0, (int)std::floor(lo.x)), x1 = std::min(size - 1, (int)std::ceil(hi.x));
+		int y0 = std::max(0, (int)std::floor(lo.y)), y1 = std::min(size - 1, (int)std::ceil(hi.y));
+		for(int y = y0; y <= y1; y++) {
+			for(int x = x0; x <= x1; x++) {
+				glm::vec2 p(x + 0.5f, y + 0.5f);
+				float b1 = ((p.x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (p.y - uv[0].y)) / area;
+				float b2 = ((uv[1].x - uv[0].x) * (p.y - uv[0].y) - (p.x - uv[0].x) * (uv[1].y - uv[0].y)) / area;
+				if(b1 < 0.0f || b2 < 0.0f || b1 + b2 > 1.0f)
+					continue;
+				TexelSample &sample = samples[(size_t)y * size + x];
+				sample.triangle = (unsigned int)t;
+				sample.b1 = b1;
+				sample.b2 = b2;
+			}
+		}
+	}
+
+	// 2. cast rays for all covered texels
+	const std::vector<Vertex> &highVertices = *high.vertices;
+	parallelFor(samples.size(), [&](size_t begin, size_t end) {
+		for(size_t s = begin; s < end; s++) {
+			const TexelSample &sample = samples[s];
+			if(sample.triangle == ~0u)
+				continue;
+			const unsigned int *tri = &low.indices[sample.triangle * 3];
+			float b0 = 1.0f - sample.b1 - sample.b2;
+			const Vertex &l0 = lowVertices[tri[0]], &l1 = lowVertices[tri[1]], &l2 = lowVertices[tri[2]];
+			glm::vec3 position = l0.Position * b0 + l1.Position * sample.b1 + l2.Position * sample.b2;
+			glm::vec3 n = safeNormalize(l0.Normal * b0 + l1.Normal * sample.b1 + l2.Normal * sample.b2,
+										glm::vec3(0.0f, 0.0f, 1.0f));
+			glm::vec3 t = glm::vec3(l0.Tangent) * b0 + glm::vec3(l1.Tangent) * sample.b1 + glm::vec3(l2.Tangent) * sample.b2;
+			t = safeNormalize(t - n * glm::dot(n, t), glm::vec3(1.0f, 0.0f, 0.0f));
+			glm::vec3 b = glm::cross(n, t) * (l0.Tangent.w < 0.0f ? -1.0f : 1.0f);
+
+			// closest hit on the high mesh in front of or behind the low surface
+			Hit hit, back;
+			glm::vec3 rayDirection = n;
+			bool found = bvh.intersect(position, n, searchDistance, hit);
+			if(bvh.intersect(position, -n, found ? hit.t : searchDistance, back)) {
+				hit = back;
+				rayDirection = -n;
+				found = true;
+			}
+
+			glm::vec3 normal(0.0f, 0.0f, 1.0f);
+			float ao = 1.0f;
+			if(found) {
+				const unsigned int *h = &high.indices[hit.triangle * 3];
+				float c0 = 1.0f - hit.u - hit.v;
+				const Vertex &h0 = highVertices[h[0]], &h1 = highVertices[h[1]], &h2 = highVertices[h[2]];
+				glm::vec3 hn = safeNormalize(h0.Normal * c0 + h1.Normal * hit.u + h2.Normal * hit.v, n);
+				glm::vec3 world = hn;
+				if(detail) {
+					glm::vec2 uv = h0.TexCoord * c0 + h1.TexCoord * hit.u + h2.TexCoord * hit.v;
+					glm::vec3 ht = glm::vec3(h0.Tangent) * c0 + glm::vec3(h1.Tangent) * hit.u + glm::vec3(h2.Tangent) * hit.v;
+					ht = safeNormalize(ht - hn * glm::dot(hn, ht), t);
+					glm::vec3 hb = glm::cross(hn, ht) * (h0.Tangent.w < 0.0f ? -1.0f : 1.0f);
+					glm::vec3 d = sampleNormal(*detail, uv);
+					world = safeNormalize(ht * d.x + hb * d.y + hn * d.z, hn);
+				}
+				normal = safeNormalize(glm::vec3(glm::dot(world, t), glm::dot(world, b), glm::dot(world, n)),
+									   glm::vec3(0.0f, 0.0f, 1.0f));
+
+				if(settings.ambientOcclusion && settings.aoSamples > 0) {
+					glm::vec3 hitPosition = position + rayDirection * hit.t;
+					glm::vec3 ax = std::fabs(hn.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+					glm::vec3 tx = glm::normalize(glm::cross(ax, hn));
+					glm::vec3 ty = glm::cross(hn, tx);
+					glm::vec3 origin = hitPosition + hn * (1e-4f * diagonal);
+					// cosine weighted hemisphere, stratified per sample and jittered per texel
+					unsigned int seed = hash((unsigned int)s);
+					int occluded = 0;
+					for(int i = 0; i < settings.aoSamples; i++) {
+						float r1 = (i + (hash(seed + i) & 0xffff) / 65536.0f) / settings.aoSamples;
+						float r2 = (hash(seed ^ (i * 0x9e3779b9u)) & 0xffff) / 65536.0f;
+						float radius = std::sqrt(r1);
+						float phi = 6.2831853f * r2;
+						glm::vec3 direction = tx * (radius * std::cos(phi)) + ty * (radius * std::sin(phi)) +
+											  hn * std::sqrt(std::max(0.0f, 1.0f - r1));
+						occluded += bvh.occluded(origin, direction, aoDistance);
+					}
+					ao = 1.0f - (float)occluded / settings.aoSamples;
+				}
+			}
+
+			unsigned char *pixel = &image.pixels[s * 4];
+			pixel[0] = (unsigned char)glm::clamp(normal.x * 127.5f + 127.5f, 0.0f, 255.0f);
+			pixel[1] = (unsigned char)glm::clamp(normal.y * 127.5f + 127.5f, 0.0f, 255.0f);
+			pixel[2] = (unsigned char)glm::clamp(normal.z * 127.5f + 127.5f, 0.0f, 255.0f);
+			pixel[3] = (unsigned char)(ao * 255.0f + 0.5f);
+		}
+	});
+
+	// 3. dilate into the empty texels around UV islands, so filtering and mipmaps don't pull in black
+	std::vector<unsigned char> covered(samples.size());
+	for(size_t i = 0; i < samples.size(); i++)
+		covered[i] = samples[i].triangle != ~0u;
+	for(int pass = 0; pass < 4; pass++) {
+		std::vector<unsigned char> next(covered);
+		for(int y = 0; y < size; y++) {
+			for(int x = 0; x < size; x++) {
+				size_t i = (size_t)y * size + x;
+				if(covered[i])
+					continue;
+				int sum[4] = { 0, 0, 0, 0 }, n = 0;
+				for(int dy = -1; dy <= 1; dy++) {
+					for(int dx = -1; dx <= 1; dx++) {
+						int nx = x + dx, ny = y + dy;
+						if(nx < 0 || ny < 0 || nx >= size || ny >= size || !covered[(size_t)ny * size + nx])
+							continue;
+						const unsigned char *p = &image.pixels[((size_t)ny * size + nx) * 4];
+						for(int c = 0; c < 4; c++)
+							sum[c] += p[c];
+						n++;
+					}
+				}
+				if(n == 0)
+					continue;
+				for(int c = 0; c < 4; c++)
+					image.pixels[i * 4 + c] = (unsigned char)(sum[c] / n);
+				next[i] = 1;
+			}
+		}
+		covered.swap(next);
+	}
+	// flat normal and no occlusion where nothing was baked
+	for(size_t i = 0; i < covered.size(); i++) {
+		if(!covered[i]) {
+			image.pixels[i * 4 + 0] = 128;
+			image.pixels[i * 4 + 1] = 128;
+			image.pixels[i * 4 + 2] = 255;
+			image.pixels[i * 4 + 3] = 255;
+		}
+	}
+	return image;
+}
@@ -0,0 +1,45 @@
+#ifndef NORMAL_BAKER_H
+#define NORMAL_BAKER_H
+
+#include "mesh.h"
+
+#include <vector>
+
+/*
+high to low normal map baking: every texel covered by the low mesh in UV space casts a ray
+along the low surface normal onto the high mesh (both directions, closest hit wins). the high
+surface normal at the hit, optionally perturbed by the high mesh's own detail normal map, is
+stored in the tangent space of the low mesh. the high mesh is traversed through a BVH and
+texels are baked on worker threads.
+*/
+struct BakeSettings {
+	int resolution = 512;
+	// search distance along the low normal, relative to the high mesh bounds diagonal
+	float maxDistance = 0.05f;
+	// ambient occlusion of the high mesh in the alpha channel (1 = unoccluded)
+	bool ambientOcclusion = false;
+	int aoSamples = 16;
+	float aoDistance = 0.1f;	// relative to the bounds diagonal
+};
+
+// 8-bit image as loaded by stb_image (row 0 is v = 0, matching the flipped assimp UVs)
+struct BakeImage {
+	int width = 0;
+	int height = 0;
+	int components = 0;
+	std::vector<unsigned char> pixels;
+};
+
+// triangle list referencing a vertex array; LODs of one mesh share the vertices
+struct BakeMesh {
+	const std::vector<Vertex> *vertices;
+	const unsigned int *indices;
+	size_t indexCount;
+};
+
+// returns an RGBA image: tangent space normal in RGB, ambient occlusion (or 255) in A.
+// detail is the tangent space normal map of the high mesh and may be NULL
+BakeImage bakeNormalMap(const BakeMesh &high, const BakeMesh &low, const BakeImage *detail,
+						const BakeSettings &settings = BakeSettings());
+
+#endif // NORMAL_BAKER_H
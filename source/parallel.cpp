@@ -0,0 +1,29 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// below this many items per thread the thread startup costs more than it saves
+static const size_t MIN_ITEMS_PER_THREAD = 1024;
+
+void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)> &body, unsigned int threadCount) {
+	if(threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	size_t threads = std::min<size_t>(threadCount, (count + MIN_ITEMS_PER_THREAD - 1) / MIN_ITEMS_PER_THREAD);
+	if(threads <= 1) {
+		if(count > 0)
+			body(0, count);
+		return;
+	}
+
+	size_t step = (count + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	for(size_t begin = step; begin < count; begin += step) {
+		workers.push_back(std::thread(body, begin, std::min(begin + step, count)));
+	}
+	// the calling thread takes the first range
+	body(0, std::min(step, count));
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
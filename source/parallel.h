@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// splits [0, count) into contiguous ranges and runs body(begin, end) on worker threads.
+// threadCount 0 uses all hardware threads; small workloads run on the calling thread
+void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)> &body, unsigned int threadCount = 0);
+
+#endif // PARALLEL_H
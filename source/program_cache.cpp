@@ -0,0 +1,122 @@
+#include "program_cache.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// file layout: magic, binary format, binary length, binary
+const unsigned int PROGRAM_BINARY_MAGIC = 0x42505343;	// "CSPB"
+
+// 64-bit FNV-1a
+unsigned long long hashString(const std::string &text, unsigned long long hash = 14695981039346656037ull) {
+	for(size_t i = 0; i < text.size(); i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string glString(GLenum name) {
+	const GLubyte *value = glGetString(name);
+	return value ? std::string((const char*)value) : std::string();
+}
+
+void makeDirectory(const std::string &directory) {
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+}
+
+} // namespace
+
+ProgramCache::ProgramCache(const std::string &directory) {
+	this->directory = directory;
+	driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+	GLint formats = 0;
+	if(GLAD_GL_VERSION_4_1)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	supported = formats > 0;
+	if(supported)
+		makeDirectory(directory);
+}
+
+std::string ProgramCache::Key(const std::string &vertexCode, const std::string &fragmentCode) const {
+	// the separators keep moving text between the parts from producing the same hash
+	unsigned long long hash = hashString(driver);
+	hash = hashString('\0' + vertexCode, hash);
+	hash = hashString('\0' + fragmentCode, hash);
+	char key[17];
+	for(int i = 0; i < 16; i++)
+		key[i] = "0123456789abcdef"[(hash >> (60 - 4 * i)) & 0xf];
+	key[16] = '\0';
+	return key;
+}
+
+unsigned int ProgramCache::Load(const std::string &key) {
+	if(!supported)
+		return 0;
+	std::ifstream file(path(key).c_str(), std::ios::binary);
+	unsigned int header[3];
+	if(!file.read((char*)header, sizeof(header)) || header[0] != PROGRAM_BINARY_MAGIC)
+		return 0;
+	// the binary has to fill the rest of the file exactly, anything else is a truncated or corrupt entry
+	std::streamoff start = file.tellg();
+	file.seekg(0, std::ios::end);
+	std::streamoff remaining = file.tellg() - start;
+	if(header[2] == 0 || remaining != (std::streamoff)header[2]) {
+		std::cout << "ERROR::PROGRAM_CACHE::CORRUPT_ENTRY " << path(key) << std::endl;
+		return 0;
+	}
+	file.seekg(start);
+	std::vector<char> binary(header[2]);
+	if(!file.read(&binary[0], binary.size()))
+		return 0;
+
+	unsigned int program = glCreateProgram();
+	glProgramBinary(program, header[1], &binary[0], binary.size());
+	int success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if(!success) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ProgramCache::Store(const std::string &key, unsigned int program) {
+	if(!supported)
+		return;
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format;
+	glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+	std::ofstream file(path(key).c_str(), std::ios::binary | std::ios::trunc);
+	unsigned int header[3] = { PROGRAM_BINARY_MAGIC, format, (unsigned int)length };
+	file.write((const char*)header, sizeof(header));
+	file.write(&binary[0], length);
+	if(!file)
+		std::cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED " << path(key) << std::endl;
+}
+
+std::string ProgramCache::path(const std::string &key) const {
+	return directory + '/' + key + ".bin";
+}
+
+ProgramCache &programCache() {
+	static ProgramCache cache("shader_cache");
+	return cache;
+}
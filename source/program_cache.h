@@ -0,0 +1,38 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+
+/*
+linked programs saved to disk with glGetProgramBinary and restored with glProgramBinary on the
+next launch instead of compiling the GLSL again. an entry is keyed by a hash of the final shader
+sources (so defines are part of it) and the vendor, renderer and version strings of the driver.
+drivers may still reject a binary (e.g. after an update that kept the version string), the
+program is compiled from source then and the entry replaced
+*/
+class ProgramCache {
+public:
+	ProgramCache(const std::string &directory);
+	// program binaries need GL 4.1 and at least one binary format
+	bool Supported() const { return supported; }
+
+	std::string Key(const std::string &vertexCode, const std::string &fragmentCode) const;
+	// linked program, 0 if there is no entry or the driver rejects it
+	unsigned int Load(const std::string &key);
+	void Store(const std::string &key, unsigned int program);
+
+private:
+	std::string directory;
+	// vendor, renderer and version, part of every key
+	std::string driver;
+	bool supported;
+
+	std::string path(const std::string &key) const;
+};
+
+// the cache of all shaders in "shader_cache", created on first use (needs a current GL context)
+ProgramCache &programCache();
+
+#endif // PROGRAM_CACHE_H
@@ -0,0 +1,91 @@
+#include "quantize.h"
+#include "tangent_space.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+
+QuantizationBounds computeQuantizationBounds(const std::vector<Vertex> &vertices) {
+	QuantizationBounds bounds;
+	if(vertices.empty()) {
+		bounds.offset = glm::vec3(0.0f);
+		bounds.scale = glm::vec3(1.0f);
+		return bounds;
+	}
+	glm::vec3 minimum = vertices[0].Position;
+	glm::vec3 maximum = vertices[0].Position;
+	for(size_t i = 1; i < vertices.size(); i++) {
+		minimum = glm::min(minimum, vertices[i].Position);
+		maximum = glm::max(maximum, vertices[i].Position);
+	}
+	bounds.offset = minimum;
+	// flat meshes still need a non-zero scale on the collapsed axis
+	bounds.scale = glm::max(maximum - minimum, glm::vec3(1e-6f));
+	return bounds;
+}
+
+void packVertices(const std::vector<Vertex> &vertices, const QuantizationBounds &bounds,
+				  std::vector<PackedPosition> &positions, std::vector<PackedAttributes> &attributes) {
+	positions.resize(vertices.size());
+	attributes.resize(vertices.size());
+	glm::vec3 invScale = 1.0f / bounds.scale;
+	for(size_t i = 0; i < vertices.size(); i++) {
+		const Vertex &v = vertices[i];
+		glm::vec3 position = (v.Position - bounds.offset) * invScale;
+		PackedPosition &pp = positions[i];
+		pp.Position[0] = glm::packUnorm1x16(position.x);
+		pp.Position[1] = glm::packUnorm1x16(position.y);
+		pp.Position[2] = glm::packUnorm1x16(position.z);
+		pp.Position[3] = 0;
+		PackedAttributes &p = attributes[i];
+		glm::quat q = encodeQTangent(v.Normal, v.Tangent);
+		p.QTangent[0] = (short)glm::packSnorm1x16(q.x);
+		p.QTangent[1] = (short)glm::packSnorm1x16(q.y);
+		p.QTangent[2] = (short)glm::packSnorm1x16(q.z);
+		p.QTangent[3] = (short)glm::packSnorm1x16(q.w);
+		p.TexCoord[0] = glm::packHalf1x16(v.TexCoord.x);
+		p.TexCoord[1] = glm::packHalf1x16(v.TexCoord.y);
+	}
+}
+
+std::vector<MeshChunk> splitMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+								 size_t maxVertices) {
+	std::vector<MeshChunk> chunks;
+	if(vertices.size() <= maxVertices) {
+		MeshChunk chunk;
+		chunk.vertices = vertices;
+		chunk.indices = indices;
+		chunks.push_back(chunk);
+		return chunks;
+	}
+
+	// global -> local vertex index of the current chunk, stamped with the chunk number
+	std::vector<unsigned int> local(vertices.size());
+	std::vector<unsigned int> stamp(vertices.size(), 0);
+	unsigned int current = 1;
+	chunks.push_back(MeshChunk());
+
+	for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+		size_t missing = 0;
+		for(int k = 0; k < 3; k++) {
+			if(stamp[indices[i + k]] != current)
+				missing++;
+		}
+		// start a new chunk when this triangle would not fit anymore
+		if(chunks.back().vertices.size() + missing > maxVertices) {
+			chunks.push_back(MeshChunk());
+			current++;
+		}
+		MeshChunk &chunk = chunks.back();
+		for(int k = 0; k < 3; k++) {
+			unsigned int index = indices[i + k];
+			if(stamp[index] != current) {
+				stamp[index] = current;
+				local[index] = (unsigned int)chunk.vertices.size();
+				chunk.vertices.push_back(vertices[index]);
+			}
+			chunk.indices.push_back(local[index]);
+		}
+	}
+	return chunks;
+}
@@ -0,0 +1,46 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "mesh.h"
+
+#include <vector>
+
+/*
+compact GPU vertex layout (20 instead of 48 bytes), split into two streams so
+depth-only passes fetch nothing but positions:
+position stream (8 bytes): unorm16, relative to the mesh bounds (decoded with positionOffset/positionScale)
+attribute stream (12 bytes):
+	tangent frame: snorm16 quaternion (QTangent), handedness in the sign of w
+	texture coords: half floats, so repeating UVs outside [0, 1] survive
+*/
+struct PackedPosition {
+	unsigned short Position[4];	// w is padding to keep the vertices 4 byte aligned
+};
+
+struct PackedAttributes {
+	short QTangent[4];
+	unsigned short TexCoord[2];
+};
+
+// bounds used to dequantize positions: position = offset + packed * scale
+struct QuantizationBounds {
+	glm::vec3 offset;
+	glm::vec3 scale;
+};
+
+QuantizationBounds computeQuantizationBounds(const std::vector<Vertex> &vertices);
+void packVertices(const std::vector<Vertex> &vertices, const QuantizationBounds &bounds,
+				  std::vector<PackedPosition> &positions, std::vector<PackedAttributes> &attributes);
+
+// part of a mesh that is small enough for 16-bit indices
+struct MeshChunk {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+};
+
+// splits a triangle list into chunks referencing at most maxVertices vertices each.
+// vertices shared by triangles of different chunks are duplicated
+std::vector<MeshChunk> splitMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+								 size_t maxVertices = 65536);
+
+#endif // QUANTIZE_H
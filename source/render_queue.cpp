@@ -0,0 +1,107 @@
+#include "render_queue.h"
+#include "geometry_pool.h"
+
+#include <algorithm>
+
+const float RenderQueue::MAX_DEPTH = 100.0f;
+
+namespace {
+
+const uint64_t DEPTH_MASK = (1 << 24) - 1;
+
+uint64_t quantizeDepth(float depth) {
+	float normalized = std::min(std::max(depth / RenderQueue::MAX_DEPTH, 0.0f), 1.0f);
+	return (uint64_t)(normalized * DEPTH_MASK);
+}
+
+} // namespace
+
+void RenderQueue::Clear() {
+	items.clear();
+	entries.clear();
+}
+
+void RenderQueue::Submit(const RenderItem &item, float depth) {
+	uint64_t shader = item.shader->ID & 0xff;
+	uint64_t material = item.mesh->textures.empty() ? 0 : item.mesh->textures[0].id & 0xffff;
+	uint64_t vao = item.pass == PASS_DEPTH ? 1 : 0;
+	uint64_t z = quantizeDepth(depth);
+
+	SortEntry entry;
+	entry.key = (uint64_t)item.pass << 62;
+	if(item.pass == PASS_TRANSPARENT)
+		entry.key |= (DEPTH_MASK - z) << 38 | shader << 30 | material << 14;
+	else
+		entry.key |= shader << 54 | material << 38 | vao << 37 | z << 13;
+	entry.item = items.size();
+	items.push_back(item);
+	entries.push_back(entry);
+}
+
+void RenderQueue::Sort() {
+	// LSD radix sort on 8-bit digits, digits all keys share are skipped
+	scratch.resize(entries.size());
+	for(int shift = 0; shift < 64; shift += 8) {
+		size_t counts[256] = {};
+		for(size_t i = 0; i < entries.size(); i++)
+			counts[(entries[i].key >> shift) & 0xff]++;
+		if(entries.empty() || counts[(entries[0].key >> shift) & 0xff] == entries.size())
+			continue;
+		size_t offset = 0;
+		for(int d = 0; d < 256; d++) {
+			size_t count = counts[d];
+			counts[d] = offset;
+			offset += count;
+		}
+		for(size_t i = 0; i < entries.size(); i++)
+			scratch[counts[(entries[i].key >> shift) & 0xff]++] = entries[i];
+		entries.swap(scratch);
+	}
+}
+
+void RenderQueue::Execute(RenderPass pass, ObjectUniformBuffer &objects, RenderQueueStats *stats) {
+	GeometryPool &pool = geometryPool();
+	// nothing is assumed to be bound when a pass starts
+	Shader *currentShader = NULL;
+	unsigned int currentObject = ~0u;
+	const Mesh *currentTextures = NULL;
+	unsigned int currentTextureLod = 0;
+	size_t draws = 0, changes = 0, unsortedChanges = 0;
+
+	for(size_t i = 0; i < entries.size(); i++) {
+		if((RenderPass)(entries[i].key >> 62) != pass)
+			continue;
+		RenderItem &item = items[entries[i].item];
+		if(item.shader != currentShader) {
+			item.shader->use();
+			currentShader = item.shader;
+			changes++;
+		}
+		if(item.object != currentObject) {
+			objects.Bind(item.object);
+			currentObject = item.object;
+			changes++;
+		}
+		bool positionsOnly = pass == PASS_DEPTH;
+		if(!positionsOnly && (!currentTextures || !currentTextures->SameTextures(currentTextureLod, *item.mesh, item.lod))) {
+			item.mesh->BindTextures(item.lod);
+			currentTextures = item.mesh;
+			currentTextureLod = item.lod;
+			changes += item.mesh->textures.size();
+		}
+		// all meshes share the VAO of the pool, bound by the first draw of the pass
+		if(draws == 0)
+			changes++;
+		item.mesh->DrawGeometry(*item.shader, positionsOnly, item.lod, item.view, item.stats);
+		draws++;
+		// program, object block, every texture and the VAO for each draw
+		unsortedChanges += 3 + (positionsOnly ? 0 : item.mesh->textures.size());
+	}
+	pool.Unbind();
+
+	if(stats) {
+		stats->draws += draws;
+		stats->stateChanges += changes;
+		stats->unsortedStateChanges += unsortedChanges;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "mesh.h"
+#include "shader.h"
+#include "uniform_buffer.h"
+
+#include <stdint.h>
+#include <vector>
+
+// passes execute in this order, each one on its own (the caller switches blend and depth state in between)
+enum RenderPass {
+	PASS_DEPTH = 0,
+	PASS_OPAQUE = 1,
+	PASS_TRANSPARENT = 2
+};
+
+// one draw of a mesh, resolved into a 64-bit sort key when submitted
+struct RenderItem {
+	Mesh *mesh;
+	Shader *shader;
+	unsigned int lod;
+	// index into the ObjectUniformBuffer of the frame
+	unsigned int object;
+	const ClusterCullView *view;
+	ClusterCullStats *stats;
+	RenderPass pass;
+};
+
+struct RenderQueueStats {
+	size_t draws = 0;
+	// program, object block, texture and VAO binds issued by the queue
+	size_t stateChanges = 0;
+	// the binds the same draws issue when drawn unsorted with unconditional binds (Model::Draw)
+	size_t unsortedStateChanges = 0;
+};
+
+/*
+draws are collected per frame and radix sorted by a key (most significant bits first):
+	opaque and depth: pass | shader | material | VAO | depth (front to back)
+	transparent:      pass | depth (back to front) | shader | material
+so draws sharing state run next to each other, and only state that differs from the previous draw is set
+*/
+class RenderQueue {
+public:
+	void Clear();
+	// depth: distance of the item from the camera
+	void Submit(const RenderItem &item, float depth);
+	void Sort();
+	// runs the sorted items of one pass
+	void Execute(RenderPass pass, ObjectUniformBuffer &objects, RenderQueueStats *stats = NULL);
+
+	// far end of the depth range stored in the keys, farther items share the last key value
+	static const float MAX_DEPTH;
+
+private:
+	struct SortEntry {
+		uint64_t key;
+		unsigned int item;
+	};
+	std::vector<RenderItem> items;
+	std::vector<SortEntry> entries;
+	// radix sort ping-pong buffer, kept between frames
+	std::vector<SortEntry> scratch;
+};
+
+#endif // RENDER_QUEUE_H
@@ -1,6 +1,16 @@
 #include <shader.h>
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "program_cache.h"
+
+#include <GLFW/glfw3.h>
 
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -8,45 +18,218 @@
 #include <glm/gtc/type_ptr.hpp>
 
 
-Shader::Shader(const char *vertexPath, const char *fragmentPath) {
-	// 1. retrieve vertex/fragment shader source code from path
+// feature #defines in ShaderFeature bit order, with the GLSL version they need
+static const struct {
+	const char *define;
+	int version;
+} shaderFeatures[SHADER_FEATURE_COUNT] = {
+	{"NORMAL_MAP", 330},
+	{"SPECULAR_MAP", 330},
+	{"ALPHA", 330},
+	{"INSTANCED", 330},
+	{"INDIRECT", 460},
+	{"VERTEX_PULLING", 460},
+	{"VERTEX_LIGHTING", 330}
+};
+
+// without KHR_parallel_shader_compile, Ready() waits for at most this many programs per frame
+static const unsigned int SHADER_FINISHES_PER_FRAME = 1;
+// frame counter of beginShaderFrame and the programs Ready() waited for in the current frame
+static unsigned int shaderFrame = 0;
+static unsigned int shaderFinishes = 0;
+
+static bool readShaderFile(const std::string &path, std::string &code) {
+	std::ifstream file;
+	file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	try {
+		file.open(path.c_str());
+		std::stringstream stream;
+		stream << file.rdbuf();
+		file.close();
+		code = stream.str();
+	}
+	catch(const std::ifstream::failure &e) {
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// appends the file to the source, with its includes expanded. #line directives keep the line
+// numbers of compile errors right, the file index is the source string number of the error
+// removes "." and "dir/.." components, so one file is the same string however it was reached
+static std::string normalizePath(const std::string &path) {
+	std::vector<std::string> parts;
+	size_t start = 0;
+	while(start <= path.size()) {
+		size_t end = path.find('/', start);
+		if(end == std::string::npos)
+			end = path.size();
+		std::string part = path.substr(start, end - start);
+		if(part == ".." && !parts.empty() && parts.back() != "..")
+			parts.pop_back();
+		else if(part != "." && (!part.empty() || parts.empty()))
+			parts.push_back(part);
+		start = end + 1;
+	}
+	std::string normalized;
+	for(size_t i = 0; i < parts.size(); i++) {
+		if(i > 0)
+			normalized += '/';
+		normalized += parts[i];
+	}
+	return normalized;
+}
+
+static bool expandIncludes(const std::string &path, unsigned int features, std::vector<std::string> &files,
+						   std::string &source) {
+	std::string code;
+	if(!readShaderFile(path, code))
+		return false;
+	unsigned int file = files.size();
+	files.push_back(path);
+	std::string directory = path.substr(0, path.find_last_of('/') + 1);
+
+	std::istringstream lines(code);
+	std::string line;
+	char directive[32];
+	for(unsigned int number = 1; std::getline(lines, line); number++) {
+		size_t first = line.find_first_not_of(" \t");
+		if(first != std::string::npos && line.compare(first, 8, "#version") == 0) {
+			// the version line stays first, followed by the features
+			int version = std::atoi(line.c_str() + first + 8);
+			for(int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+				if(features & (1u << i))
+					version = std::max(version, shaderFeatures[i].version);
+			}
+			std::snprintf(directive, sizeof(directive), "#version %d core\n", version);
+			source += directive;
+			for(int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+				if(features & (1u << i))
+					source += std::string("#define ") + shaderFeatures[i].define + "\n";
+			}
+			std::snprintf(directive, sizeof(directive), "#line %u %u\n", number + 1, file);
+			source += directive;
+			continue;
+		}
+		if(first == std::string::npos || line.compare(first, 8, "#include") != 0) {
+			source += line;
+			source += '\n';
+			continue;
+		}
+		size_t open = line.find('"', first + 8);
+		size_t close = open != std::string::npos ? line.find('"', open + 1) : std::string::npos;
+		if(close == std::string::npos) {
+			std::cout << "ERROR::SHADER::INVALID_INCLUDE " << path << ":" << number << std::endl;
+			return false;
+		}
+		std::string include = normalizePath(directory + line.substr(open + 1, close - open - 1));
+		// every file once, like an include guard
+		if(std::find(files.begin(), files.end(), include) != files.end())
+			continue;
+		std::snprintf(directive, sizeof(directive), "#line 1 %u\n", (unsigned int)files.size());
+		source += directive;
+		if(!expandIncludes(include, features, files, source))
+			return false;
+		std::snprintf(directive, sizeof(directive), "#line %u %u\n", number + 1, file);
+		source += directive;
+	}
+	return true;
+}
+
+bool preprocessShader(const std::string &path, unsigned int features, std::string &source) {
+	source.clear();
+	std::vector<std::string> files;
+	return expandIncludes(normalizePath(path), features, files, source);
+}
+
+Shader::Shader(const char *vertexPath, const char *fragmentPath, unsigned int features) {
+	// 1. retrieve vertex/fragment shader source code from path, includes and features resolved
 	std::string vertexCode;
 	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	// exception stuff
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try {
-		// open files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
-		// read file buffer content into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		// close file handlers
-		vShaderFile.close();
-		fShaderFile.close();
-		// convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-	}
-	catch(std::ifstream::failure e) {
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+	bool preprocessed = preprocessShader(vertexPath, features, vertexCode);
+	preprocessed = preprocessShader(fragmentPath, features, fragmentCode) && preprocessed;
+
+	// 2. restore the program from the binary cache or start building it from source
+	for(int i = 0; i < UNIFORM_COUNT; i++)
+		uniforms[i] = -1;
+	vertex = fragment = 0;
+	ready = false;
+	failed = false;
+	issuedFrame = shaderFrame;
+	if(!preprocessed) {
+		// nothing worth compiling, the program is never handed out
+		ID = 0;
+		ready = true;
+		failed = true;
+		return;
+	}
+	ProgramCache &cache = programCache();
+	cacheKey = cache.Key(vertexCode, fragmentCode);
+	ID = cache.Load(cacheKey);
+	if(ID != 0) {
+		vertex = fragment = 0;
+		reflectUniforms();
+		ready = true;
+	}
+	else {
+		compile(vertexCode, fragmentCode);
 	}
+}
+
+void Shader::compile(const std::string &vertexCode, const std::string &fragmentCode) {
+	/*
+	compiling and linking are only issued here, no status is queried: the driver can work on
+	the program in the background (on its own threads with KHR_parallel_shader_compile) while
+	the other shaders are issued. the results are checked by finish
+	*/
 	const char* vShaderCode = vertexCode.c_str();
 	const char* fShaderCode = fragmentCode.c_str();
 
-	// 2. compile shaders
-	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
-
-	// vertex shader
 	vertex = glCreateShader(GL_VERTEX_SHADER);
 	glShaderSource(vertex, 1, &vShaderCode, NULL);
 	glCompileShader(vertex);
+	fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment, 1, &fShaderCode, NULL);
+	glCompileShader(fragment);
+
+	// shader program
+	ID = glCreateProgram();
+	glAttachShader(ID, vertex);
+	glAttachShader(ID, fragment);
+	// the binary is only retrievable if asked for before linking
+	if(programCache().Supported())
+		glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(ID);
+}
+
+bool Shader::Ready() {
+	if(ready)
+		return !failed;
+	if(parallelShaderCompile()) {
+		int complete = 0;
+		glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+		if(!complete)
+			return false;
+	}
+	else {
+		/*
+		without the extension the status can only be known by waiting for it. the driver gets until
+		the next frame to work on the program, and a frame waits for one program at most, callers
+		keep drawing with their fallback meanwhile
+		*/
+		if(issuedFrame == shaderFrame || shaderFinishes >= SHADER_FINISHES_PER_FRAME)
+			return false;
+		shaderFinishes++;
+	}
+	finish();
+	return !failed;
+}
+
+void Shader::finish() {
+	int success;
+	char infoLog[512];
+
 	// print compile errors if any
 	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
 	if(!success) {
@@ -54,60 +237,220 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath) {
 		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" <<
 			infoLog << std::endl;
 	}
-	// fragment shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	// print compile errors if any
 	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
 	if(!success) {
 		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
 		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" <<
 				  infoLog << std::endl;
 	}
-
-	// 3. shader program
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	glLinkProgram(ID);
 	// print linking errors if any
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
 	if(!success) {
 		glGetProgramInfoLog(ID, 512, NULL, infoLog);
 		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" <<
 			infoLog << std::endl;
+		failed = true;
+	}
+	else {
+		programCache().Store(cacheKey, ID);
 	}
 
 	// delete shaders, as they are linked to the program
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+	vertex = fragment = 0;
+
+	reflectUniforms();
+	ready = true;
+}
+
+void beginShaderFrame() {
+	shaderFrame++;
+	shaderFinishes = 0;
+}
+
+bool parallelShaderCompile() {
+	static int supported = -1;
+	if(supported < 0) {
+		supported = 0;
+		int count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for(int i = 0; i < count; i++) {
+			const char *name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if(name && std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0)
+				supported = 1;
+			else if(name && std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0 && !supported)
+				supported = 2;
+		}
+		/*
+		glMaxShaderCompilerThreads: number of threads the driver may compile with, 0xFFFFFFFF lets it
+		choose. some drivers start with none until asked. not part of the generated loader either
+		*/
+		typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+		MaxShaderCompilerThreadsProc maxShaderCompilerThreads = NULL;
+		if(supported == 1)
+			maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		else if(supported == 2)
+			maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+		if(maxShaderCompilerThreads)
+			maxShaderCompilerThreads(0xFFFFFFFF);
+	}
+	return supported > 0;
+}
+
+int materialTextureUnit(const std::string &type, unsigned int number) {
+	// numbers start at 1, texture_diffuse0 is not a material sampler
+	if(number == 0)
+		return -1;
+	int unit;
+	if(type == "texture_diffuse")
+		unit = TEXTURE_UNIT_DIFFUSE;
+	else if(type == "texture_specular")
+		unit = TEXTURE_UNIT_SPECULAR;
+	else if(type == "texture_normal")
+		unit = TEXTURE_UNIT_NORMAL;
+	else
+		return -1;
+	return (number - 1) * MATERIAL_TEXTURE_UNITS + unit;
+}
+
+void Shader::reflectUniforms() {
+	/*
+	glGetActiveUniform: name, size and type of an active uniform of the linked program.
+	arrays are reported as "name[0]" and are stored under both names
+	*/
+	int count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::string buffer(std::max(maxLength, 1), '\0');
+
+	// samplers keep their unit for the lifetime of the program
+	unsigned int previousProgram = glState().Program();
+	glState().UseProgram(ID);
+	int nextUnit = 0;
+	std::vector<std::pair<int, std::string> > otherSamplers;
+	for(int i = 0; i < count; i++) {
+		int length = 0, size = 0;
+		GLenum type;
+		glGetActiveUniform(ID, i, maxLength, &length, &size, &type, &buffer[0]);
+		std::string name(buffer.c_str(), length);
+		int location = glGetUniformLocation(ID, name.c_str());
+		if(location < 0)	// uniform block members
+			continue;
+		uniformLocations[name] = location;
+		if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			uniformLocations[name.substr(0, name.size() - 3)] = location;
+
+		if(type != GL_SAMPLER_2D && type != GL_SAMPLER_2D_ARRAY && type != GL_SAMPLER_CUBE)
+			continue;
+		// material samplers: type name followed by the texture number
+		size_t digits = name.find_last_not_of("0123456789") + 1;
+		int unit = digits < name.size() ? materialTextureUnit(name.substr(0, digits), std::atoi(name.c_str() + digits)) : -1;
+		if(unit >= 0) {
+			glUniform1i(location, unit);
+			nextUnit = std::max(nextUnit, unit + 1);
+		}
+		else {
+			otherSamplers.push_back(std::make_pair(location, name));
+		}
+	}
+	// any other samplers follow the material units
+	nextUnit = (nextUnit + MATERIAL_TEXTURE_UNITS - 1) / MATERIAL_TEXTURE_UNITS * MATERIAL_TEXTURE_UNITS;
+	for(size_t i = 0; i < otherSamplers.size(); i++)
+		glUniform1i(otherSamplers[i].first, nextUnit++);
+	glState().UseProgram(previousProgram);
+
+	// uniform blocks are bound to their fixed binding points, see uniform_buffer.h
+	unsigned int block = glGetUniformBlockIndex(ID, "Frame");
+	if(block != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, block, FRAME_UNIFORM_BINDING);
+	block = glGetUniformBlockIndex(ID, "Object");
+	if(block != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, block, OBJECT_UNIFORM_BINDING);
+	block = glGetUniformBlockIndex(ID, "Materials");
+	if(block != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, block, MATERIAL_UNIFORM_BINDING);
+
+	uniforms[UNIFORM_POSITION_OFFSET] = location("positionOffset");
+	uniforms[UNIFORM_POSITION_SCALE] = location("positionScale");
+	uniforms[UNIFORM_DRAW_OFFSET] = location("drawOffset");
+	uniforms[UNIFORM_MATERIAL] = location("material");
+}
+
+void Shader::Wait() {
+	if(!ready)
+		finish();
 }
 
 void Shader::use() {
-	glUseProgram(ID);
+	// first use of a program that is still being built waits for it
+	if(!ready)
+		finish();
+	glState().UseProgram(ID);
+}
+
+int Shader::location(const std::string &name) const {
+	std::unordered_map<std::string, int>::const_iterator it = uniformLocations.find(name);
+	return it != uniformLocations.end() ? it->second : -1;
 }
 
 /*
 glUniform: set value of uniform in shader
-glGetUniformLocation: get the location of the uniform in a shader
+locations come from the table built at link time, no glGetUniformLocation per call
 */
-void Shader::setBool(const std::string &name, bool value) const {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+void Shader::setInt(ShaderUniform uniform, int value) const {
+	glUniform1i(uniforms[uniform], value);
 }
 
-void Shader::setInt(const std::string &name, int value) const {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+void Shader::setFloat(ShaderUniform uniform, float value) const {
+	glUniform1f(uniforms[uniform], value);
 }
 
-void Shader::setFloat(const std::string &name, float value) const {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+void Shader::setVec3(ShaderUniform uniform, const glm::vec3 &vec) const {
+	glUniform3fv(uniforms[uniform], 1, &vec[0]);
 }
 
-void Shader::setVec3(const std::string &name, glm::vec3 &vec) const {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &vec[0]);
+void Shader::setVec4(ShaderUniform uniform, const glm::vec4 &vec) const {
+	glUniform4fv(uniforms[uniform], 1, &vec[0]);
 }
 
-void Shader::setMat4(const std::string &name, glm::mat4 &mat) const {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-}
\ No newline at end of file
+ShaderPermutations::ShaderPermutations(const char *vertexPath, const char *fragmentPath) {
+	this->vertexPath = vertexPath;
+	this->fragmentPath = fragmentPath;
+}
+
+ShaderPermutations::~ShaderPermutations() {
+	for(std::map<unsigned int, Shader*>::iterator it = programs.begin(); it != programs.end(); ++it)
+		delete it->second;
+}
+
+Shader &ShaderPermutations::permutation(unsigned int features) {
+	std::map<unsigned int, Shader*>::iterator it = programs.find(features);
+	if(it != programs.end())
+		return *it->second;
+	Shader *shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), features);
+	programs[features] = shader;
+	return *shader;
+}
+
+void ShaderPermutations::Prepare(unsigned int features) {
+	permutation(features);
+}
+
+bool ShaderPermutations::Ready(unsigned int features) {
+	return permutation(features).Ready();
+}
+
+void ShaderPermutations::Wait() {
+	for(std::map<unsigned int, Shader*>::iterator it = programs.begin(); it != programs.end(); ++it)
+		it->second->Wait();
+}
+
+Shader &ShaderPermutations::Get(unsigned int features) {
+	Shader &shader = permutation(features);
+	if(shader.Ready() || (features & SHADER_MATERIAL_FEATURES) == 0)
+		return shader;
+	// the base permutation lights with the vertex normal and samples the diffuse map only. it also stands
+	// in for good if the permutation failed to build
+	return permutation(features & ~SHADER_MATERIAL_FEATURES);
+}
@@ -4,23 +4,148 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <map>
 #include <string>
+#include <unordered_map>
+
+// uniforms set on every draw, their locations are resolved once at link time
+enum ShaderUniform {
+    UNIFORM_POSITION_OFFSET,
+    UNIFORM_POSITION_SCALE,
+    UNIFORM_DRAW_OFFSET,
+    UNIFORM_MATERIAL,
+    UNIFORM_COUNT
+};
+
+// material samplers texture_diffuseN, texture_specularN and texture_normalN are bound to
+// fixed texture units at link time, so meshes bind their textures without uniform calls
+enum MaterialTextureUnit {
+    TEXTURE_UNIT_DIFFUSE,
+    TEXTURE_UNIT_SPECULAR,
+    TEXTURE_UNIT_NORMAL,
+    MATERIAL_TEXTURE_UNITS
+};
+// unit of the number-th (starting at 1) texture of a type ("texture_diffuse", ...), -1 for unknown types
+// and number 0
+int materialTextureUnit(const std::string &type, unsigned int number);
+
+/*
+compile-time features of a shader permutation. each one is a #define injected into both stages
+(resources/shaders/shader.vs and shader.fs), so a program only contains the work its draws need
+*/
+enum ShaderFeature {
+    SHADER_NORMAL_MAP = 1 << 0,         // tangent space lighting with texture_normal1
+    SHADER_SPECULAR_MAP = 1 << 1,       // texture_specular1 modulates the specular color
+    SHADER_ALPHA = 1 << 2,              // outputs the opacity of the material and the frame
+    SHADER_INSTANCED = 1 << 3,          // transforms from instance attributes instead of the Object block
+    SHADER_INDIRECT = 1 << 4,           // per-draw data from the DrawData buffer by gl_DrawID (GLSL 4.60)
+    SHADER_VERTEX_PULLING = 1 << 5,     // vertices from the geometry pool's storage buffers (GLSL 4.60)
+    SHADER_VERTEX_LIGHTING = 1 << 6,    // lighting per vertex and biased mips, for distant draws
+    SHADER_FEATURE_COUNT = 7
+};
+// the features that only select the quality of the shading (material maps, lighting rate).
+// without them a permutation can draw any mesh
+const unsigned int SHADER_MATERIAL_FEATURES = SHADER_NORMAL_MAP | SHADER_SPECULAR_MAP | SHADER_VERTEX_LIGHTING;
+
+// shading cost tiers of a draw (see Mesh::ShaderFeatures), coarser tiers drop per-fragment work
+// of draws that cover few pixels
+enum ShadingLOD {
+    SHADING_FULL,       // all maps of the material
+    SHADING_SIMPLE,     // no normal or specular map, lit per fragment with the vertex normal
+    SHADING_VERTEX,     // lit per vertex, the diffuse map is sampled with a mip bias
+    SHADING_LODS
+};
+
+// reads a shader with the files it #includes (paths relative to the including file, each file is
+// included once) and inserts a #define for every feature after the #version line, raising the
+// version if a feature needs it. false if a file can't be read
+bool preprocessShader(const std::string &path, unsigned int features, std::string &source);
+
+// GL_COMPLETION_STATUS of KHR/ARB_parallel_shader_compile, not part of the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+// true if programs can be polled for completion. the first call also lets the driver use as many
+// compiler threads as it likes
+bool parallelShaderCompile();
+// call once per frame. without the extension Ready() waits for one program per frame at most, and
+// only for programs issued in an earlier frame
+void beginShaderFrame();
 
 class Shader {
 public:
     // shader program ID
     unsigned int ID;
 
-    // reading and building shaders from file
-    Shader(const char* vertexPath, const char* fragmentPath);
-    // activate shader
+    // reading and building shaders from file with the given ShaderFeature bits. compiling runs
+    // asynchronously where the driver allows it, construct all shaders up front so their builds overlap
+    Shader(const char* vertexPath, const char* fragmentPath, unsigned int features = 0);
+    // true once the program is linked. doesn't block with KHR_parallel_shader_compile, without it
+    // waits within the budget of beginShaderFrame. until then callers draw with a program that is
+    // ready instead. never true if a file couldn't be read or the program failed to compile or link
+    bool Ready();
+    // blocks until the program is linked
+    void Wait();
+    // activate shader, blocks until the program is linked
     void use();
-    // utility uniform functions
-    void setBool(const std::string &name, bool value) const;
-    void setInt(const std::string &name, int value) const;
-    void setFloat(const std::string &name, float value) const;
-    void setVec3(const std::string &name, glm::vec3 &vec) const;
-    void setMat4(const std::string &name, glm::mat4 &value) const;
+    // location of an active uniform, -1 if the program has none by that name
+    int location(const std::string &name) const;
+    // utility uniform functions, through the locations resolved at link time
+    void setInt(ShaderUniform uniform, int value) const;
+    void setFloat(ShaderUniform uniform, float value) const;
+    void setVec3(ShaderUniform uniform, const glm::vec3 &vec) const;
+    void setVec4(ShaderUniform uniform, const glm::vec4 &vec) const;
+
+private:
+    // all active uniforms, enumerated after linking
+    std::unordered_map<std::string, int> uniformLocations;
+    int uniforms[UNIFORM_COUNT];
+
+    // building from source: shaders until they are linked, cache entry to store the result in
+    unsigned int vertex, fragment;
+    std::string cacheKey;
+    bool ready;
+    // value of the beginShaderFrame counter when compiling was issued
+    unsigned int issuedFrame;
+    // preprocessing, compiling or linking failed
+    bool failed;
+
+    // issues compiling and linking without waiting for them
+    void compile(const std::string &vertexCode, const std::string &fragmentCode);
+    // waits for the program, reports errors and enumerates the uniforms
+    void finish();
+    void reflectUniforms();
+};
+
+/*
+the permutations of one vertex and fragment shader pair, by ShaderFeature mask. a permutation is
+built the first time it is asked for and kept, its binary goes to the program cache like that of
+any other program. only the combinations that are actually drawn are ever compiled
+*/
+class ShaderPermutations {
+public:
+    ShaderPermutations(const char* vertexPath, const char* fragmentPath);
+    ~ShaderPermutations();
+    // starts building a permutation without waiting for it
+    void Prepare(unsigned int features);
+    // true once the permutation is linked, starts building it if it wasn't yet
+    bool Ready(unsigned int features);
+    // the permutation, or while it is still being built (or if it failed) the one without the material
+    // features (it can draw any mesh, just with less detail). blocks only if that one isn't ready either
+    Shader &Get(unsigned int features);
+    // blocks until every permutation asked for so far is linked
+    void Wait();
+    // permutations built so far
+    size_t Count() const { return programs.size(); }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::map<unsigned int, Shader*> programs;
+
+    Shader &permutation(unsigned int features);
+    // owns the programs
+    ShaderPermutations(const ShaderPermutations &);
+    ShaderPermutations &operator=(const ShaderPermutations &);
 };
 
 #endif // SHADER_H
@@ -0,0 +1,331 @@
+#include "simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// error function p^T A p + 2 b^T p + c, with A symmetric. w holds the accumulated triangle area
+struct Quadric {
+	double a00, a11, a22, a10, a20, a21;
+	double b0, b1, b2;
+	double c;
+	double w;
+};
+
+Quadric quadricFromPlane(const glm::vec3 &n, float d, float w) {
+	Quadric q;
+	q.a00 = n.x * n.x * w;
+	q.a11 = n.y * n.y * w;
+	q.a22 = n.z * n.z * w;
+	q.a10 = n.y * n.x * w;
+	q.a20 = n.z * n.x * w;
+	q.a21 = n.z * n.y * w;
+	q.b0 = n.x * d * w;
+	q.b1 = n.y * d * w;
+	q.b2 = n.z * d * w;
+	q.c = (double)d * d * w;
+	q.w = w;
+	return q;
+}
+
+void quadricAdd(Quadric &q, const Quadric &r) {
+	q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+	q.a10 += r.a10; q.a20 += r.a20; q.a21 += r.a21;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+	q.w += r.w;
+}
+
+// squared distance of p to the planes accumulated in q (area weighted average)
+double quadricError(const Quadric &q, const glm::vec3 &p) {
+	double rx = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z + q.b0;
+	double ry = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z + q.b1;
+	double rz = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z + q.b2;
+	double r = rx * p.x + ry * p.y + rz * p.z + q.b0 * p.x + q.b1 * p.y + q.b2 * p.z + q.c;
+	return std::fabs(r) / (q.w > 0.0 ? q.w : 1.0);
+}
+
+unsigned int hashBytes(const void *data, size_t size) {
+	// FNV-1a
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+	unsigned int h = 2166136261u;
+	for(size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+struct VertexHasher {
+	const Vertex *vertices;
+	size_t operator()(unsigned int i) const { return hashBytes(&vertices[i], sizeof(Vertex)); }
+};
+
+struct VertexEqual {
+	const Vertex *vertices;
+	bool operator()(unsigned int a, unsigned int b) const {
+		return std::memcmp(&vertices[a], &vertices[b], sizeof(Vertex)) == 0;
+	}
+};
+
+struct PositionHasher {
+	const Vertex *vertices;
+	size_t operator()(unsigned int i) const { return hashBytes(&vertices[i].Position, sizeof(glm::vec3)); }
+};
+
+struct PositionEqual {
+	const Vertex *vertices;
+	bool operator()(unsigned int a, unsigned int b) const {
+		return vertices[a].Position == vertices[b].Position;
+	}
+};
+
+struct Collapse {
+	unsigned int from, to;
+	float cost;		// ranking cost, geometric error plus attribute penalty
+	float error;	// geometric error only
+};
+
+bool collapseLess(const Collapse &a, const Collapse &b) {
+	return a.cost < b.cost;
+}
+
+unsigned long long edgeKey(unsigned int a, unsigned int b) {
+	return ((unsigned long long)a << 32) | b;
+}
+
+} // namespace
+
+std::vector<unsigned int> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+									   size_t targetIndexCount, float *resultError, const SimplifyOptions &options) {
+	std::vector<unsigned int> result(indices);
+	if(resultError)
+		*resultError = 0.0f;
+	if(result.size() <= targetIndexCount || vertices.empty())
+		return result;
+
+	size_t vertexCount = vertices.size();
+
+	// 1. merge vertices with identical attributes, unwelded imports duplicate every face corner
+	std::vector<unsigned int> canonical(vertexCount);
+	std::vector<unsigned int> position(vertexCount);
+	{
+		VertexHasher vh = { &vertices[0] };
+		VertexEqual ve = { &vertices[0] };
+		std::unordered_map<unsigned int, unsigned int, VertexHasher, VertexEqual> unique(vertexCount, vh, ve);
+		PositionHasher ph = { &vertices[0] };
+		PositionEqual pe = { &vertices[0] };
+		std::unordered_map<unsigned int, unsigned int, PositionHasher, PositionEqual> positions(vertexCount, ph, pe);
+		for(unsigned int i = 0; i < vertexCount; i++) {
+			canonical[i] = unique.insert(std::make_pair(i, i)).first->second;
+			position[i] = positions.insert(std::make_pair(i, i)).first->second;
+		}
+	}
+	for(size_t i = 0; i < result.size(); i++)
+		result[i] = canonical[result[i]];
+
+	// 2. lock vertices on attribute seams (several distinct vertices share a position)
+	// and on open borders (an edge without its opposite half-edge)
+	std::vector<unsigned int> wedges(vertexCount, 0);
+	for(unsigned int i = 0; i < vertexCount; i++) {
+		if(canonical[i] == i)
+			wedges[position[i]]++;
+	}
+	std::vector<unsigned char> lockedPosition(vertexCount, 0);
+	{
+		std::unordered_set<unsigned long long> edges;
+		edges.reserve(result.size());
+		for(size_t i = 0; i < result.size(); i += 3) {
+			for(int e = 0; e < 3; e++) {
+				unsigned int a = position[result[i + e]];
+				unsigned int b = position[result[i + (e + 1) % 3]];
+				edges.insert(edgeKey(a, b));
+			}
+		}
+		for(size_t i = 0; i < result.size(); i += 3) {
+			for(int e = 0; e < 3; e++) {
+				unsigned int a = position[result[i + e]];
+				unsigned int b = position[result[i + (e + 1) % 3]];
+				if(edges.find(edgeKey(b, a)) == edges.end()) {
+					lockedPosition[a] = 1;
+					lockedPosition[b] = 1;
+				}
+			}
+		}
+	}
+	std::vector<unsigned char> locked(vertexCount, 0);
+	for(unsigned int i = 0; i < vertexCount; i++) {
+		locked[i] = lockedPosition[position[i]] || wedges[position[i]] > 1;
+	}
+
+	// 3. per vertex quadrics from the planes of the adjacent triangles
+	Quadric zero;
+	std::memset(&zero, 0, sizeof(Quadric));
+	std::vector<Quadric> quadrics(vertexCount, zero);
+	for(size_t i = 0; i < result.size(); i += 3) {
+		const glm::vec3 &p0 = vertices[result[i + 0]].Position;
+		const glm::vec3 &p1 = vertices[result[i + 1]].Position;
+		const glm::vec3 &p2 = vertices[result[i + 2]].Position;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if(length == 0.0f)
+			continue;
+		normal /= length;
+		Quadric q = quadricFromPlane(normal, -glm::dot(normal, p0), length * 0.5f);
+		quadricAdd(quadrics[result[i + 0]], q);
+		quadricAdd(quadrics[result[i + 1]], q);
+		quadricAdd(quadrics[result[i + 2]], q);
+	}
+
+	// 4. collapse passes: rank all edges, then apply the cheapest independent collapses
+	float maxError = 0.0f;
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<unsigned char> touched(vertexCount);
+	std::vector<Collapse> collapses;
+
+	while(result.size() > targetIndexCount) {
+		// vertex -> triangle adjacency
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for(size_t i = 0; i < result.size(); i++)
+			adjacencyOffsets[result[i] + 1]++;
+		for(size_t i = 0; i < vertexCount; i++)
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		adjacency.resize(result.size());
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for(size_t i = 0; i < result.size(); i++)
+			adjacency[fill[result[i]]++] = (unsigned int)(i / 3);
+
+		// every half-edge a->b proposes collapsing a onto b
+		collapses.clear();
+		for(size_t i = 0; i < result.size(); i += 3) {
+			for(int e = 0; e < 3; e++) {
+				unsigned int a = result[i + e];
+				unsigned int b = result[i + (e + 1) % 3];
+				if(locked[a])
+					continue;
+				const Vertex &va = vertices[a];
+				const Vertex &vb = vertices[b];
+				Quadric q = quadrics[a];
+				quadricAdd(q, quadrics[b]);
+				double error = quadricError(q, vb.Position);
+				glm::vec3 edge = vb.Position - va.Position;
+				glm::vec2 uv = vb.TexCoord - va.TexCoord;
+				double penalty = (options.normalWeight * (1.0f - glm::dot(va.Normal, vb.Normal)) +
+								  options.uvWeight * glm::dot(uv, uv)) * glm::dot(edge, edge);
+				Collapse c;
+				c.from = a;
+				c.to = b;
+				c.error = (float)std::sqrt(error);
+				c.cost = (float)(error + penalty);
+				if(c.error <= options.maxError)
+					collapses.push_back(c);
+			}
+		}
+		if(collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), collapseLess);
+
+		for(unsigned int i = 0; i < vertexCount; i++)
+			remap[i] = i;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+		size_t trianglesRemoved = 0;
+		size_t applied = 0;
+		for(size_t c = 0; c < collapses.size() && trianglesRemoved < trianglesToRemove; c++) {
+			unsigned int a = collapses[c].from;
+			unsigned int b = collapses[c].to;
+			if(touched[a] || touched[b])
+				continue;
+
+			// reject collapses that flip one of the remaining triangles around a
+			bool flips = false;
+			size_t shared = 0;
+			const glm::vec3 &target = vertices[b].Position;
+			for(unsigned int t = adjacencyOffsets[a]; t < adjacencyOffsets[a + 1] && !flips; t++) {
+				const unsigned int *tri = &result[adjacency[t] * 3];
+				if(tri[0] == b || tri[1] == b || tri[2] == b) {
+					shared++;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for(int k = 0; k < 3; k++) {
+					p[k] = vertices[tri[k]].Position;
+					q[k] = tri[k] == a ? target : p[k];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flips = glm::dot(before, after) <= 0.0f;
+			}
+			if(flips)
+				continue;
+
+			// the one-ring of a changes shape, keep it out of further collapses in this pass
+			for(unsigned int t = adjacencyOffsets[a]; t < adjacencyOffsets[a + 1]; t++) {
+				const unsigned int *tri = &result[adjacency[t] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+			remap[a] = b;
+			quadricAdd(quadrics[b], quadrics[a]);
+			maxError = std::max(maxError, collapses[c].error);
+			trianglesRemoved += shared;
+			applied++;
+		}
+		if(applied == 0)
+			break;
+
+		// apply the collapses and drop the degenerate triangles
+		size_t write = 0;
+		for(size_t i = 0; i < result.size(); i += 3) {
+			unsigned int i0 = remap[result[i + 0]];
+			unsigned int i1 = remap[result[i + 1]];
+			unsigned int i2 = remap[result[i + 2]];
+			if(i0 == i1 || i1 == i2 || i2 == i0)
+				continue;
+			result[write + 0] = i0;
+			result[write + 1] = i1;
+			result[write + 2] = i2;
+			write += 3;
+		}
+		result.resize(write);
+	}
+
+	if(resultError)
+		*resultError = maxError;
+	return result;
+}
+
+std::vector<MeshLOD> generateLODChain(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+									  const std::vector<float> &ratios, const SimplifyOptions &options) {
+	std::vector<MeshLOD> lods;
+	MeshLOD base;
+	base.indexOffset = 0;
+	base.indexCount = (unsigned int)indices.size();
+	base.error = 0.0f;
+	lods.push_back(base);
+
+	// every level is simplified from the full detail mesh, so its error is relative to the original surface
+	std::vector<unsigned int> source(indices);
+	for(size_t i = 0; i < ratios.size(); i++) {
+		size_t target = (size_t)(source.size() / 3 * ratios[i]) * 3;
+		float error = 0.0f;
+		std::vector<unsigned int> simplified = simplifyMesh(vertices, source, target, &error, options);
+		// stop once the simplifier makes no more progress (e.g. everything left is locked)
+		if(simplified.empty() || simplified.size() >= lods.back().indexCount)
+			break;
+
+		MeshLOD lod;
+		lod.indexOffset = (unsigned int)indices.size();
+		lod.indexCount = (unsigned int)simplified.size();
+		lod.error = std::max(error, lods.back().error);
+		lods.push_back(lod);
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+	}
+	return lods;
+}
@@ -0,0 +1,36 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include "mesh.h"
+
+#include <vector>
+
+/*
+quadric error metric (QEM) mesh simplification based on Garland & Heckbert:
+vertices are collapsed onto one of their edge neighbours in order of the
+smallest quadric error. vertices on open borders (material boundaries, since
+assimp splits meshes by material) and on attribute seams (UV seams, hard
+normals) are locked, so those stay watertight and keep their texture layout.
+*/
+struct SimplifyOptions {
+	// penalty weights for the attribute change caused by a collapse
+	float normalWeight = 0.5f;
+	float uvWeight = 1.0f;
+	// collapses with a larger geometric error than this are rejected (object space units)
+	float maxError = 1e30f;
+};
+
+// simplifies the triangle list towards targetIndexCount indices, returns the new index list.
+// the resulting indices reference the unchanged vertex array. resultError receives
+// the largest geometric deviation (object space) introduced by the collapses.
+std::vector<unsigned int> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+									   size_t targetIndexCount, float *resultError,
+									   const SimplifyOptions &options = SimplifyOptions());
+
+// generates one LOD per ratio (fraction of the full detail triangle count) and appends their
+// index lists to indices. returns the LOD chain including the full detail level as LOD 0.
+std::vector<MeshLOD> generateLODChain(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+									  const std::vector<float> &ratios,
+									  const SimplifyOptions &options = SimplifyOptions());
+
+#endif // SIMPLIFY_H
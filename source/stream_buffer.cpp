@@ -0,0 +1,125 @@
+#include "stream_buffer.h"
+#include "gl_state.h"
+
+#include <iostream>
+
+// region size of each frame before the first growth
+const size_t INITIAL_FRAME_SIZE = 1 << 20;
+// glClientWaitSync timeout per try
+const GLuint64 FENCE_TIMEOUT = 1000000;
+
+// the GL offset alignments are not required to be powers of two
+static size_t alignUp(size_t offset, size_t alignment) {
+	return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+StreamBuffer::StreamBuffer(size_t frameSize) {
+	persistent = GLAD_GL_VERSION_4_4 != 0;
+	mapping = NULL;
+	frame = 0;
+	head = 0;
+	for(unsigned int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+		fences[i] = 0;
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	uniformAlignment = alignment;
+	alignment = 256;
+	if(GLAD_GL_VERSION_4_3)
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	storageAlignment = alignment;
+	create(frameSize);
+}
+
+void StreamBuffer::create(size_t frameSize) {
+	this->frameSize = frameSize;
+	size_t size = frameSize * STREAM_BUFFER_FRAMES;
+	glGenBuffers(1, &buffer);
+	glState().BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if(persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+		mapping = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+		if(!mapping) {
+			std::cout << "ERROR::STREAM_BUFFER::MAPPING_FAILED, staging writes instead" << std::endl;
+			glState().DeleteBuffer(buffer);
+			persistent = false;
+			create(frameSize);
+			return;
+		}
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+		staging.resize(size);
+		mapping = &staging[0];
+	}
+}
+
+void StreamBuffer::grow(size_t required) {
+	// the old buffer may still be bound for earlier allocations of this frame, it is deleted next frame
+	retired.push_back(buffer);
+	size_t size = frameSize * 2;
+	while(size < required)
+		size *= 2;
+	create(size);
+	// nothing of the new buffer is in use, older fences guard the old one only
+	for(unsigned int i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+		if(fences[i])
+			glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+	std::cout << "stream buffer grown to " << size / 1024 << " KB per frame" << std::endl;
+}
+
+void StreamBuffer::BeginFrame() {
+	for(size_t i = 0; i < retired.size(); i++)
+		glState().DeleteBuffer(retired[i]);
+	retired.clear();
+
+	frame = (frame + 1) % STREAM_BUFFER_FRAMES;
+	head = 0;
+	if(!fences[frame])
+		return;
+	// flush once so the fence is guaranteed to signal, then wait
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while(glClientWaitSync(fences[frame], flags, FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED)
+		flags = 0;
+	glDeleteSync(fences[frame]);
+	fences[frame] = 0;
+}
+
+void StreamBuffer::EndFrame() {
+	if(fences[frame])
+		glDeleteSync(fences[frame]);
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamAllocation StreamBuffer::Allocate(size_t size, size_t alignment) {
+	// aligned in the whole buffer, frame regions don't start at a multiple of alignment
+	size_t base = frame * frameSize;
+	size_t offset = alignUp(base + head, alignment) - base;
+	if(offset + size > frameSize) {
+		grow(size + alignment);
+		base = frame * frameSize;
+		offset = alignUp(base, alignment) - base;
+	}
+	head = offset + size;
+
+	StreamAllocation allocation;
+	allocation.buffer = buffer;
+	allocation.offset = base + offset;
+	allocation.size = size;
+	allocation.data = mapping + allocation.offset;
+	return allocation;
+}
+
+void StreamBuffer::Commit(const StreamAllocation &allocation) {
+	if(persistent || allocation.size == 0)
+		return;
+	glState().BindBuffer(GL_COPY_WRITE_BUFFER, allocation.buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset, allocation.size, allocation.data);
+}
+
+StreamBuffer &streamBuffer() {
+	static StreamBuffer stream(INITIAL_FRAME_SIZE);
+	return stream;
+}
@@ -0,0 +1,68 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <vector>
+
+// frames the CPU may write ahead of the GPU, each one owns a region of the buffer
+const unsigned int STREAM_BUFFER_FRAMES = 3;
+
+// space for per-frame data, written through data and then committed
+struct StreamAllocation {
+	unsigned int buffer;	// the buffer can change when a frame outgrows its region
+	size_t offset;			// bytes from the start of buffer
+	size_t size;
+	void *data;
+};
+
+/*
+ring of frame regions in one buffer for data that is rewritten every frame (uniforms, instance
+transforms, indirect commands). the buffer is mapped once, persistently and coherently
+(GL 4.4 buffer storage), and every allocation is a bump of the head of the current region, so
+writes neither orphan nor copy. a fence after the last draw of a frame guards its region, it is
+waited on when the ring comes around to it again, which only blocks if the GPU is more than
+STREAM_BUFFER_FRAMES frames behind.
+without buffer storage the allocations are staged in memory and Commit uploads them
+*/
+class StreamBuffer {
+public:
+	StreamBuffer(size_t frameSize);
+
+	// moves to the next region, waiting for the GPU to finish the frame that used it
+	void BeginFrame();
+	// fences the region of the frame, call after its last draw
+	void EndFrame();
+	// the offset into the buffer is a multiple of alignment. a frame that runs out of space continues in a
+	// larger buffer, earlier allocations stay valid in the old one until the next frame
+	StreamAllocation Allocate(size_t size, size_t alignment);
+	// makes the written data visible to GL (nothing to do for a coherent mapping)
+	void Commit(const StreamAllocation &allocation);
+
+	bool Persistent() const { return persistent; }
+	// offset alignment of uniform and shader storage buffer ranges
+	size_t UniformAlignment() const { return uniformAlignment; }
+	size_t StorageAlignment() const { return storageAlignment; }
+
+private:
+	unsigned int buffer;
+	bool persistent;
+	unsigned char *mapping;
+	std::vector<unsigned char> staging;
+	size_t frameSize;
+	unsigned int frame;
+	size_t head;
+	GLsync fences[STREAM_BUFFER_FRAMES];
+	// buffers replaced during the current frame, deleted at the next BeginFrame
+	std::vector<unsigned int> retired;
+	size_t uniformAlignment, storageAlignment;
+
+	void create(size_t frameSize);
+	void grow(size_t required);
+};
+
+// the ring shared by all per-frame data, created on first use (needs a current GL context)
+StreamBuffer &streamBuffer();
+
+#endif // STREAM_BUFFER_H
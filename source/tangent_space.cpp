@@ -0,0 +1,183 @@
+#include "tangent_space.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// corners are grouped by position, normal and texture coordinate
+struct CornerKey {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoord;
+};
+
+struct CornerHasher {
+	const Vertex *vertices;
+	size_t operator()(unsigned int i) const {
+		CornerKey key = { vertices[i].Position, vertices[i].Normal, vertices[i].TexCoord };
+		// FNV-1a
+		const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&key);
+		unsigned int h = 2166136261u;
+		for(size_t k = 0; k < sizeof(CornerKey); k++) {
+			h ^= bytes[k];
+			h *= 16777619u;
+		}
+		return h;
+	}
+};
+
+struct CornerEqual {
+	const Vertex *vertices;
+	bool operator()(unsigned int a, unsigned int b) const {
+		return vertices[a].Position == vertices[b].Position && vertices[a].Normal == vertices[b].Normal &&
+			   vertices[a].TexCoord == vertices[b].TexCoord;
+	}
+};
+
+glm::vec3 safeNormalize(const glm::vec3 &v, const glm::vec3 &fallback) {
+	float length = glm::length(v);
+	return length > 1e-20f ? v / length : fallback;
+}
+
+// any unit vector perpendicular to n
+glm::vec3 orthogonal(const glm::vec3 &n) {
+	glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(glm::cross(axis, n));
+}
+
+} // namespace
+
+void generateTangents(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+	size_t faceCount = indices.size() / 3;
+	size_t vertexCount = vertices.size();
+	if(faceCount == 0)
+		return;
+
+	// 1. face tangents and UV orientation
+	std::vector<glm::vec3> faceTangents(faceCount);
+	std::vector<signed char> faceSigns(faceCount);
+	parallelFor(faceCount, [&](size_t begin, size_t end) {
+		for(size_t f = begin; f < end; f++) {
+			const Vertex &v0 = vertices[indices[f * 3 + 0]];
+			const Vertex &v1 = vertices[indices[f * 3 + 1]];
+			const Vertex &v2 = vertices[indices[f * 3 + 2]];
+			glm::vec3 d1 = v1.Position - v0.Position;
+			glm::vec3 d2 = v2.Position - v0.Position;
+			glm::vec2 st1 = v1.TexCoord - v0.TexCoord;
+			glm::vec2 st2 = v2.TexCoord - v0.TexCoord;
+			float signedArea = st1.x * st2.y - st1.y * st2.x;
+			// like MikkTSpace, faces with degenerate UVs count as orientation preserving
+			float sign = signedArea < 0.0f ? -1.0f : 1.0f;
+			faceTangents[f] = sign * (st2.y * d1 - st1.y * d2);
+			faceSigns[f] = (signed char)sign;
+		}
+	});
+
+	// 2. group the corners, one group per shared vertex and orientation
+	std::vector<unsigned int> groups(indices.size());
+	size_t groupCount;
+	{
+		CornerHasher hasher = { &vertices[0] };
+		CornerEqual equal = { &vertices[0] };
+		std::unordered_map<unsigned int, unsigned int, CornerHasher, CornerEqual> unique(vertexCount, hasher, equal);
+		std::vector<unsigned int> canonical(vertexCount);
+		for(unsigned int i = 0; i < vertexCount; i++)
+			canonical[i] = unique.insert(std::make_pair(i, (unsigned int)unique.size())).first->second;
+		groupCount = unique.size() * 2;
+		for(size_t c = 0; c < indices.size(); c++)
+			groups[c] = canonical[indices[c]] * 2 + (faceSigns[c / 3] < 0 ? 1 : 0);
+	}
+	std::vector<unsigned int> groupOffsets(groupCount + 1, 0);
+	for(size_t c = 0; c < indices.size(); c++)
+		groupOffsets[groups[c] + 1]++;
+	for(size_t g = 0; g < groupCount; g++)
+		groupOffsets[g + 1] += groupOffsets[g];
+	std::vector<unsigned int> groupCorners(indices.size());
+	{
+		std::vector<unsigned int> fill(groupOffsets.begin(), groupOffsets.end() - 1);
+		for(size_t c = 0; c < indices.size(); c++)
+			groupCorners[fill[groups[c]]++] = (unsigned int)c;
+	}
+
+	// 3. angle weighted sum of the projected face tangents per group
+	std::vector<glm::vec3> groupTangents(groupCount);
+	parallelFor(groupCount, [&](size_t begin, size_t end) {
+		for(size_t g = begin; g < end; g++) {
+			glm::vec3 sum(0.0f);
+			glm::vec3 n(0.0f, 0.0f, 1.0f);
+			for(unsigned int k = groupOffsets[g]; k < groupOffsets[g + 1]; k++) {
+				unsigned int c = groupCorners[k];
+				size_t face = c / 3;
+				const Vertex &v = vertices[indices[c]];
+				const Vertex &next = vertices[indices[face * 3 + (c % 3 + 1) % 3]];
+				const Vertex &prev = vertices[indices[face * 3 + (c % 3 + 2) % 3]];
+				n = safeNormalize(v.Normal, n);
+
+				glm::vec3 t = faceTangents[face];
+				t -= n * glm::dot(n, t);
+				if(glm::dot(t, t) < 1e-20f)
+					continue;
+				t = glm::normalize(t);
+
+				// corner angle between the edges projected into the tangent plane
+				glm::vec3 e1 = next.Position - v.Position;
+				glm::vec3 e2 = prev.Position - v.Position;
+				e1 = safeNormalize(e1 - n * glm::dot(n, e1), glm::vec3(0.0f));
+				e2 = safeNormalize(e2 - n * glm::dot(n, e2), glm::vec3(0.0f));
+				float angle = std::acos(glm::clamp(glm::dot(e1, e2), -1.0f, 1.0f));
+				sum += t * angle;
+			}
+			groupTangents[g] = glm::dot(sum, sum) > 1e-20f ? glm::normalize(sum) : orthogonal(n);
+		}
+	});
+
+	// 4. write back, duplicating vertices used with both orientations
+	std::vector<signed char> assigned(vertexCount, 0);
+	std::vector<unsigned int> mirrored(vertexCount, ~0u);
+	for(size_t c = 0; c < indices.size(); c++) {
+		unsigned int v = indices[c];
+		float sign = faceSigns[c / 3];
+		glm::vec4 tangent(groupTangents[groups[c]], sign);
+		if(assigned[v] == 0) {
+			vertices[v].Tangent = tangent;
+			assigned[v] = faceSigns[c / 3];
+		}
+		else if(assigned[v] != faceSigns[c / 3]) {
+			if(mirrored[v] == ~0u) {
+				Vertex copy = vertices[v];
+				copy.Tangent = tangent;
+				mirrored[v] = (unsigned int)vertices.size();
+				vertices.push_back(copy);
+			}
+			indices[c] = mirrored[v];
+		}
+	}
+}
+
+glm::quat encodeQTangent(const glm::vec3 &normal, const glm::vec4 &tangent) {
+	glm::vec3 n = safeNormalize(normal, glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::vec3 t = glm::vec3(tangent);
+	t = safeNormalize(t - n * glm::dot(n, t), orthogonal(n));
+	glm::vec3 b = glm::cross(n, t);
+
+	glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+	// q and -q are the same rotation, so the sign of w is free to carry the handedness.
+	// keep w away from zero so the sign survives 16-bit quantization
+	if(q.w < 0.0f)
+		q = -q;
+	const float bias = 1.0f / 32767.0f;
+	if(q.w < bias) {
+		float scale = std::sqrt(1.0f - bias * bias);
+		q.x *= scale;
+		q.y *= scale;
+		q.z *= scale;
+		q.w = bias;
+	}
+	if(tangent.w < 0.0f)
+		q = -q;
+	return q;
+}
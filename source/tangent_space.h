@@ -0,0 +1,23 @@
+#ifndef TANGENT_SPACE_H
+#define TANGENT_SPACE_H
+
+#include "mesh.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+/*
+MikkTSpace compatible tangent generation: face tangents are projected into the
+tangent plane of each corner normal and accumulated, weighted by the corner angle,
+over all corners that share position, normal, texture coordinate and UV orientation.
+tangent.w holds the bitangent sign (bitangent = w * cross(normal, tangent)).
+vertices used by faces with both UV orientations (mirrored UVs) are duplicated,
+so vertices and indices may change.
+*/
+void generateTangents(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// encodes the tangent frame as a unit quaternion (QTangent) with the handedness in the sign of w
+glm::quat encodeQTangent(const glm::vec3 &normal, const glm::vec4 &tangent);
+
+#endif // TANGENT_SPACE_H
@@ -0,0 +1,54 @@
+#include "texture_array.h"
+#include "gl_state.h"
+
+#include <algorithm>
+#include <map>
+
+unsigned int TextureArrayBuilder::Add(const unsigned char *pixels, int width, int height) {
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+	image.array = 0;
+	image.layer = 0;
+	images.push_back(image);
+	return images.size();
+}
+
+void TextureArrayBuilder::Build() {
+	// images of the same size share an array, as long as the layer limit allows
+	std::map<std::pair<int, int>, std::vector<unsigned int> > sizes;
+	for(unsigned int i = 0; i < images.size(); i++) {
+		if(images[i].array == 0)
+			sizes[std::make_pair(images[i].width, images[i].height)].push_back(i);
+	}
+	GLint maxLayers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+	for(std::map<std::pair<int, int>, std::vector<unsigned int> >::iterator it = sizes.begin(); it != sizes.end(); ++it) {
+		const std::vector<unsigned int> &members = it->second;
+		for(size_t first = 0; first < members.size(); first += maxLayers) {
+			size_t layers = std::min(members.size() - first, (size_t)maxLayers);
+			unsigned int array;
+			glGenTextures(1, &array);
+			glState().BindTexture(0, GL_TEXTURE_2D_ARRAY, array);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, it->first.first, it->first.second, layers, 0, GL_RGBA,
+						 GL_UNSIGNED_BYTE, NULL);
+			for(size_t layer = 0; layer < layers; layer++) {
+				Image &image = images[members[first + layer]];
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, image.width, image.height, 1, GL_RGBA,
+								GL_UNSIGNED_BYTE, &image.pixels[0]);
+				image.array = array;
+				image.layer = layer;
+				std::vector<unsigned char>().swap(image.pixels);
+			}
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			arrays.push_back(array);
+		}
+	}
+}
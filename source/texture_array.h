@@ -0,0 +1,39 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <vector>
+
+/*
+packs the textures of a model into GL_TEXTURE_2D_ARRAY objects, one array per image size, so
+materials differ only in layer indices and meshes with different materials bind the same
+textures. images are collected while loading and the arrays are created at once when all
+sizes and layer counts are known
+*/
+class TextureArrayBuilder {
+public:
+	// returns the handle of the image (handles start at 1, 0 stands for no image). pixels are RGBA8
+	unsigned int Add(const unsigned char *pixels, int width, int height);
+	// creates the arrays with mipmaps and releases the pixels of all added images
+	void Build();
+
+	// texture array and layer of an image, valid after Build
+	unsigned int Array(unsigned int handle) const { return handle ? images[handle - 1].array : 0; }
+	unsigned int Layer(unsigned int handle) const { return handle ? images[handle - 1].layer : 0; }
+	size_t ImageCount() const { return images.size(); }
+	size_t ArrayCount() const { return arrays.size(); }
+
+private:
+	struct Image {
+		int width, height;
+		std::vector<unsigned char> pixels;
+		unsigned int array;
+		unsigned int layer;
+	};
+	std::vector<Image> images;
+	std::vector<unsigned int> arrays;
+};
+
+#endif // TEXTURE_ARRAY_H
@@ -0,0 +1,86 @@
+#include "uniform_buffer.h"
+#include "gl_state.h"
+
+#include <cstring>
+#include <iostream>
+
+UniformBuffer::UniformBuffer(size_t size, unsigned int binding) {
+	this->size = size;
+	this->binding = binding;
+}
+
+void UniformBuffer::Update(const void *data, size_t size) {
+	StreamBuffer &stream = streamBuffer();
+	StreamAllocation block = stream.Allocate(this->size, stream.UniformAlignment());
+	std::memcpy(block.data, data, size < this->size ? size : this->size);
+	stream.Commit(block);
+	glState().BindBufferRange(GL_UNIFORM_BUFFER, binding, block.buffer, block.offset, block.size);
+}
+
+ObjectUniformBuffer::ObjectUniformBuffer() {
+	size_t alignment = streamBuffer().UniformAlignment();
+	stride = (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+	blocks.buffer = 0;
+	blocks.offset = 0;
+}
+
+void ObjectUniformBuffer::Reset() {
+	staging.clear();
+}
+
+unsigned int ObjectUniformBuffer::Add(const glm::mat4 &model) {
+	unsigned int index = staging.size() / stride;
+	staging.resize(staging.size() + stride);
+	ObjectUniforms object;
+	object.model = model;
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	for(int i = 0; i < 3; i++)
+		object.normalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+	std::memcpy(&staging[index * stride], &object, sizeof(ObjectUniforms));
+	return index;
+}
+
+void ObjectUniformBuffer::Upload() {
+	if(staging.empty())
+		return;
+	StreamBuffer &stream = streamBuffer();
+	blocks = stream.Allocate(staging.size(), stream.UniformAlignment());
+	std::memcpy(blocks.data, &staging[0], staging.size());
+	stream.Commit(blocks);
+}
+
+void ObjectUniformBuffer::Bind(unsigned int index) {
+	glState().BindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UNIFORM_BINDING, blocks.buffer, blocks.offset + index * stride,
+							  sizeof(ObjectUniforms));
+}
+
+MaterialBuffer::MaterialBuffer() {
+	uploaded = 0;
+	glGenBuffers(1, &UBO);
+	glState().BindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialUniforms), NULL, GL_STATIC_DRAW);
+	glState().BindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_UNIFORM_BINDING, UBO);
+}
+
+unsigned int MaterialBuffer::Add(const MaterialUniforms &material) {
+	if(materials.size() == MAX_MATERIALS) {
+		std::cout << "ERROR::MATERIAL_BUFFER::FULL" << std::endl;
+		return 0;
+	}
+	materials.push_back(material);
+	return materials.size() - 1;
+}
+
+void MaterialBuffer::Upload() {
+	if(uploaded == materials.size())
+		return;
+	glState().BindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, uploaded * sizeof(MaterialUniforms),
+					(materials.size() - uploaded) * sizeof(MaterialUniforms), &materials[uploaded]);
+	uploaded = materials.size();
+}
+
+MaterialBuffer &materialBuffer() {
+	static MaterialBuffer buffer;
+	return buffer;
+}
@@ -0,0 +1,104 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "stream_buffer.h"
+
+#include <vector>
+
+// binding points of the uniform blocks, set for every program at link time
+enum UniformBlockBinding {
+	FRAME_UNIFORM_BINDING = 0,
+	OBJECT_UNIFORM_BINDING = 1,
+	MATERIAL_UNIFORM_BINDING = 2
+};
+
+// size of the material table in the "Materials" block (resources/shaders/uniforms.glsl)
+const unsigned int MAX_MATERIALS = 256;
+
+/*
+std140 layouts of the uniform blocks in resources/shaders: vec3 members are padded to vec4,
+a mat3 is stored as three vec4 columns
+*/
+// block "Frame": camera and lights, uploaded once per frame and shared by all programs
+struct FrameUniforms {
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::mat4 viewProjection;
+	glm::vec4 viewPos;
+	glm::vec4 lightPos;
+	glm::vec4 lightAmbient;
+	glm::vec4 lightDiffuse;
+	glm::vec4 lightSpecular;
+	// opacity of the whole scene, read by SHADER_ALPHA permutations
+	float alpha;
+	float padding[3];
+};
+
+// block "Object": transform of one drawn object
+struct ObjectUniforms {
+	glm::mat4 model;
+	// transpose(inverse(mat3(model))), computed on the CPU instead of per vertex
+	glm::vec4 normalMatrix[3];
+};
+
+// element of the "Materials" block: scalar parameters of a material (MTL Kd, d, Ks, Ns)
+struct MaterialUniforms {
+	glm::vec4 diffuse;		// color, opacity in w
+	glm::vec4 specular;		// color, shininess in w
+};
+
+// one block rewritten every frame, each Update writes a new copy to the stream buffer and binds it
+class UniformBuffer {
+public:
+	UniformBuffer(size_t size, unsigned int binding);
+	void Update(const void *data, size_t size);
+
+private:
+	unsigned int binding;
+	size_t size;
+};
+
+// per-object blocks of a frame in one buffer, each bound as a range before its object is drawn
+class ObjectUniformBuffer {
+public:
+	ObjectUniformBuffer();
+	// starts a new frame, previously added objects are dropped
+	void Reset();
+	// returns the index to bind the object with
+	unsigned int Add(const glm::mat4 &model);
+	// uploads all added objects, call before the first Bind of a frame
+	void Upload();
+	void Bind(unsigned int index);
+
+private:
+	// range of the stream buffer holding the blocks of this frame
+	StreamAllocation blocks;
+	// std140 block size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	size_t stride;
+	std::vector<unsigned char> staging;
+};
+
+// materials of all loaded models in one table, bound once. meshes store their index into it
+class MaterialBuffer {
+public:
+	MaterialBuffer();
+	// returns the index of the material, 0 (the first one added) if the table is full
+	unsigned int Add(const MaterialUniforms &material);
+	// uploads the materials added since the last upload
+	void Upload();
+	size_t Count() const { return materials.size(); }
+	const MaterialUniforms &Get(unsigned int index) const { return materials[index]; }
+
+private:
+	unsigned int UBO;
+	size_t uploaded;
+	std::vector<MaterialUniforms> materials;
+};
+
+// the table shared by all models, created on first use (needs a current GL context)
+MaterialBuffer &materialBuffer();
+
+#endif // UNIFORM_BUFFER_H
@@ -0,0 +1,136 @@
+#include "weld.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WELD_SSE2
+#include <emmintrin.h>
+#endif
+
+// the quantization below reads a vertex as three groups of four floats
+static_assert(sizeof(Vertex) == 12 * sizeof(float), "Vertex must consist of 12 tightly packed floats");
+
+namespace {
+
+// cell coordinates are clamped to this before the conversion to int, _mm_cvtps_epi32 would return
+// 0x80000000 for anything out of range. NaN ends up at -WELD_KEY_LIMIT in both paths
+const float WELD_KEY_LIMIT = 1e9f;
+
+// quantized vertex: position, normal, texcoord, tangent as grid cell coordinates
+struct WeldKey {
+	int values[12];
+};
+
+void quantize(const std::vector<Vertex> &vertices, const WeldOptions &options, std::vector<WeldKey> &keys) {
+	// per lane scale matching the float layout of Vertex
+	float scale[12] = {
+		1.0f / options.positionEpsilon, 1.0f / options.positionEpsilon, 1.0f / options.positionEpsilon,
+		1.0f / options.normalEpsilon, 1.0f / options.normalEpsilon, 1.0f / options.normalEpsilon,
+		1.0f / options.texCoordEpsilon, 1.0f / options.texCoordEpsilon,
+		1.0f / options.tangentEpsilon, 1.0f / options.tangentEpsilon, 1.0f / options.tangentEpsilon,
+		1.0f / options.tangentEpsilon
+	};
+	keys.resize(vertices.size());
+	// both paths round to the nearest cell, ties to even (the default rounding mode)
+#ifdef WELD_SSE2
+	__m128 s0 = _mm_loadu_ps(scale + 0);
+	__m128 s1 = _mm_loadu_ps(scale + 4);
+	__m128 s2 = _mm_loadu_ps(scale + 8);
+	__m128 lower = _mm_set1_ps(-WELD_KEY_LIMIT);
+	__m128 upper = _mm_set1_ps(WELD_KEY_LIMIT);
+	for(size_t i = 0; i < vertices.size(); i++) {
+		const float *v = reinterpret_cast<const float*>(&vertices[i]);
+		__m128i *k = reinterpret_cast<__m128i*>(keys[i].values);
+		__m128 c0 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(v + 0), s0), lower), upper);
+		__m128 c1 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(v + 4), s1), lower), upper);
+		__m128 c2 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(v + 8), s2), lower), upper);
+		_mm_storeu_si128(k + 0, _mm_cvtps_epi32(c0));
+		_mm_storeu_si128(k + 1, _mm_cvtps_epi32(c1));
+		_mm_storeu_si128(k + 2, _mm_cvtps_epi32(c2));
+	}
+#else
+	for(size_t i = 0; i < vertices.size(); i++) {
+		const float *v = reinterpret_cast<const float*>(&vertices[i]);
+		for(int c = 0; c < 12; c++) {
+			// same operand order as _mm_max_ps/_mm_min_ps, so NaN clamps the same way
+			float cell = v[c] * scale[c];
+			cell = cell > -WELD_KEY_LIMIT ? cell : -WELD_KEY_LIMIT;
+			cell = cell < WELD_KEY_LIMIT ? cell : WELD_KEY_LIMIT;
+			keys[i].values[c] = (int)std::nearbyint(cell);
+		}
+	}
+#endif
+}
+
+unsigned int hashKey(const WeldKey &key) {
+	unsigned int lanes[4];
+#ifdef WELD_SSE2
+	const __m128i *k = reinterpret_cast<const __m128i*>(key.values);
+	__m128i k1 = _mm_loadu_si128(k + 1);
+	__m128i k2 = _mm_loadu_si128(k + 2);
+	// fold the three groups lane-wise, rotating to keep equal lanes from cancelling out
+	__m128i h = _mm_loadu_si128(k + 0);
+	h = _mm_xor_si128(h, _mm_or_si128(_mm_slli_epi32(k1, 5), _mm_srli_epi32(k1, 27)));
+	h = _mm_xor_si128(h, _mm_or_si128(_mm_slli_epi32(k2, 11), _mm_srli_epi32(k2, 21)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), h);
+#else
+	for(int c = 0; c < 4; c++) {
+		unsigned int k1 = key.values[4 + c];
+		unsigned int k2 = key.values[8 + c];
+		lanes[c] = (unsigned int)key.values[c] ^ ((k1 << 5) | (k1 >> 27)) ^ ((k2 << 11) | (k2 >> 21));
+	}
+#endif
+	return (lanes[0] * 73856093u) ^ (lanes[1] * 19349663u) ^ (lanes[2] * 83492791u) ^ (lanes[3] * 2654435761u);
+}
+
+bool keysEqual(const WeldKey &a, const WeldKey &b) {
+#ifdef WELD_SSE2
+	const __m128i *ka = reinterpret_cast<const __m128i*>(a.values);
+	const __m128i *kb = reinterpret_cast<const __m128i*>(b.values);
+	__m128i eq = _mm_and_si128(_mm_cmpeq_epi32(_mm_loadu_si128(ka + 0), _mm_loadu_si128(kb + 0)),
+							   _mm_cmpeq_epi32(_mm_loadu_si128(ka + 1), _mm_loadu_si128(kb + 1)));
+	eq = _mm_and_si128(eq, _mm_cmpeq_epi32(_mm_loadu_si128(ka + 2), _mm_loadu_si128(kb + 2)));
+	return _mm_movemask_epi8(eq) == 0xFFFF;
+#else
+	return std::memcmp(a.values, b.values, sizeof(a.values)) == 0;
+#endif
+}
+
+} // namespace
+
+size_t weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, const WeldOptions &options) {
+	if(vertices.empty())
+		return 0;
+
+	std::vector<WeldKey> keys;
+	quantize(vertices, options, keys);
+
+	// open addressing table of indices into the welded vertex list
+	size_t tableSize = 1;
+	while(tableSize < vertices.size() * 2)
+		tableSize *= 2;
+	std::vector<unsigned int> table(tableSize, ~0u);
+
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<unsigned int> firstOfGroup;
+	firstOfGroup.reserve(vertices.size());
+	for(size_t i = 0; i < vertices.size(); i++) {
+		size_t slot = hashKey(keys[i]) & (tableSize - 1);
+		while(table[slot] != ~0u && !keysEqual(keys[firstOfGroup[table[slot]]], keys[i]))
+			slot = (slot + 1) & (tableSize - 1);
+		if(table[slot] == ~0u) {
+			table[slot] = (unsigned int)firstOfGroup.size();
+			firstOfGroup.push_back((unsigned int)i);
+		}
+		remap[i] = table[slot];
+	}
+
+	for(size_t i = 0; i < indices.size(); i++)
+		indices[i] = remap[indices[i]];
+	std::vector<Vertex> welded(firstOfGroup.size());
+	for(size_t i = 0; i < firstOfGroup.size(); i++)
+		welded[i] = vertices[firstOfGroup[i]];
+	vertices.swap(welded);
+	return vertices.size();
+}
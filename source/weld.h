@@ -0,0 +1,22 @@
+#ifndef WELD_H
+#define WELD_H
+
+#include "mesh.h"
+
+#include <vector>
+
+// attributes closer than their epsilon (per component) are treated as equal.
+// values are snapped to an epsilon sized grid, so two values just across a grid line stay apart
+struct WeldOptions {
+	float positionEpsilon = 1e-5f;
+	float normalEpsilon = 1e-3f;
+	float texCoordEpsilon = 1e-5f;
+	float tangentEpsilon = 1e-3f;
+};
+
+// merges duplicated vertices and remaps the indices, the first vertex of every group is kept.
+// returns the number of vertices after welding
+size_t weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+					const WeldOptions &options = WeldOptions());
+
+#endif // WELD_H
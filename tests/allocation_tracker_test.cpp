@@ -0,0 +1,57 @@
+#include "allocation_tracker.h"
+
+#include <iostream>
+#include <vector>
+
+// FrameAllocationTracker without a window: allocations inside a phase must make the frame count
+// as allocating, a frame that only reuses capacity must not
+
+// kept reachable so the compiler can't drop the allocations
+std::vector<int> *volatile kept;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+	if(!condition) {
+		std::cout << "ERROR::ALLOCATION_TRACKER_TEST " << what << std::endl;
+		failures++;
+	}
+}
+
+int main() {
+	FrameAllocationTracker tracker;
+
+	// allocating in the submit phase only
+	tracker.BeginFrame();
+	tracker.BeginPhase(PHASE_SUBMIT);
+	kept = new std::vector<int>(64);
+	tracker.BeginPhase(PHASE_DRAW);
+	tracker.EndFrame();
+	check(tracker.Frames() == 1, "one frame ended");
+	check(tracker.AllocatingFrames() > 0, "allocating frame not counted");
+	check(tracker.LastFrame(PHASE_SUBMIT) >= 2, "vector and its storage not attributed to the submit phase");
+	check(tracker.LastFrame(PHASE_UPDATE) == 0, "allocation attributed to the update phase");
+	check(tracker.LastFrame(PHASE_DRAW) == 0, "allocation attributed to the draw phase");
+	check(tracker.Phase(PHASE_SUBMIT).bytes >= 64 * sizeof(int), "allocated bytes not counted");
+
+	// reusing the capacity doesn't allocate, freeing doesn't count as allocating either
+	tracker.BeginFrame();
+	tracker.BeginPhase(PHASE_SUBMIT);
+	kept->assign(32, 1);
+	tracker.BeginPhase(PHASE_DRAW);
+	delete kept;
+	kept = NULL;
+	tracker.EndFrame();
+	check(tracker.Frames() == 2, "two frames ended");
+	check(tracker.AllocatingFrames() == 1, "frame without allocations counted as allocating");
+	for(int i = 0; i < FRAME_PHASES; i++)
+		check(tracker.LastFrame((FramePhase)i) == 0, "last frame still reports allocations");
+	check(tracker.Phase(PHASE_DRAW).frees >= 2, "frees not counted");
+
+	tracker.ResetStats();
+	check(tracker.Frames() == 0 && tracker.AllocatingFrames() == 0, "stats not reset");
+
+	if(failures == 0)
+		std::cout << "allocation tracker: all checks passed" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
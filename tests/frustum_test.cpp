@@ -0,0 +1,115 @@
+#include "frustum.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// frustum.cpp twice in one binary: with the SSE2 path where the target has it, and with the scalar
+// fallback. its includes come first so they aren't pulled into the namespaces
+#if !defined(FRUSTUM_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#endif
+namespace simd {
+#include "frustum.cpp"
+}
+#undef FRUSTUM_SSE2
+#define FRUSTUM_NO_SSE2
+namespace scalar {
+#include "frustum.cpp"
+}
+
+// random boxes and spheres, then bounds that touch a plane exactly and bounds large enough to
+// reach the padding planes: both paths must agree on every one
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+	if(!condition) {
+		std::cout << "ERROR::FRUSTUM_TEST " << what << std::endl;
+		failures++;
+	}
+}
+
+static void compare(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent, float radius) {
+	check(simd::boxInFrustum(frustum, center, extent) == scalar::boxInFrustum(frustum, center, extent),
+		  "boxInFrustum differs");
+	check(simd::sphereInFrustum(frustum, center, radius) == scalar::sphereInFrustum(frustum, center, radius),
+		  "sphereInFrustum differs");
+	check(simd::sphereFrustumOverlap(frustum, center, radius) == scalar::sphereFrustumOverlap(frustum, center, radius),
+		  "sphereFrustumOverlap differs");
+	check(simd::boundsInFrustum(frustum, center, extent, radius) ==
+		  scalar::boundsInFrustum(frustum, center, extent, radius), "boundsInFrustum differs");
+}
+
+int main() {
+	std::mt19937 generator(50);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	// perspective frustums looking in random directions
+	for(int f = 0; f < 100; f++) {
+		glm::vec3 eye(unit(generator) * 10.0f, unit(generator) * 10.0f, unit(generator) * 10.0f);
+		glm::vec3 target(unit(generator), unit(generator), unit(generator));
+		glm::mat4 matrix = glm::perspective(glm::radians(30.0f + 60.0f * (unit(generator) + 1.0f)), 1.5f, 0.1f, 100.0f) *
+						   glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum = simd::extractFrustum(matrix);
+		for(int i = 0; i < 2000; i++) {
+			glm::vec3 center(unit(generator) * 50.0f, unit(generator) * 50.0f, unit(generator) * 50.0f);
+			glm::vec3 extent(std::fabs(unit(generator)) * 5.0f, std::fabs(unit(generator)) * 5.0f, std::fabs(unit(generator)) * 5.0f);
+			compare(frustum, center, extent, glm::length(extent));
+		}
+	}
+
+	// the padding lanes: normal 0 and a huge distance
+	Frustum box = simd::extractFrustum(glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 9.0f));
+	for(int i = 6; i < 8; i++) {
+		check(box.lanes[0][i] == 0.0f && box.lanes[1][i] == 0.0f && box.lanes[2][i] == 0.0f &&
+			  box.lanes[3][i] == 1e30f, "padding plane");
+	}
+
+	// an orthographic box has axis aligned planes at exact distances: x, y in [-1, 1], z in [-9, -1]
+	glm::vec3 touchingX(-2.0f, 0.0f, -5.0f);
+	compare(box, touchingX, glm::vec3(1.0f), 1.0f);
+	check(simd::boxInFrustum(box, touchingX, glm::vec3(1.0f)), "box touching the left plane is outside");
+	check(!simd::boxInFrustum(box, touchingX, glm::vec3(0.5f)), "box beyond the left plane is inside");
+	check(simd::sphereFrustumOverlap(box, touchingX, 1.0f) == FRUSTUM_INTERSECTING, "sphere touching the left plane");
+	glm::vec3 touchingFar(0.0f, 0.0f, -10.0f);
+	compare(box, touchingFar, glm::vec3(1.0f), 1.0f);
+	check(simd::boxInFrustum(box, touchingFar, glm::vec3(1.0f)), "box touching the far plane is outside");
+	check(simd::sphereFrustumOverlap(box, glm::vec3(0.0f, 0.0f, -5.0f), 1.0f) == FRUSTUM_INSIDE,
+		  "sphere inside all planes");
+	check(simd::sphereFrustumOverlap(box, glm::vec3(0.0f, 0.0f, -5.0f), 2.0f) == FRUSTUM_INTERSECTING,
+		  "sphere touching the side planes from inside");
+	for(int i = 0; i < 10000; i++) {
+		// touching one of the six planes from outside, with extents that are exact in float
+		glm::vec3 extent((float)(generator() % 8) * 0.25f, (float)(generator() % 8) * 0.25f,
+						 (float)(generator() % 8) * 0.25f);
+		glm::vec3 center(0.0f, 0.0f, -5.0f);
+		int axis = i % 3;
+		bool positive = (i / 3) % 2 == 0;
+		if(axis < 2)
+			center[axis] = positive ? 1.0f + extent[axis] : -1.0f - extent[axis];
+		else
+			center.z = positive ? -1.0f + extent.z : -9.0f - extent.z;
+		compare(box, center, extent, extent[axis]);
+		check(simd::boxInFrustum(box, center, extent), "box touching a plane is outside");
+	}
+
+	// bounds that reach the padding planes. with every real plane even further away only the
+	// padding lanes make the sphere cross, so a path that skips them disagrees
+	compare(box, glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(1e29f), 2e30f);
+	compare(box, glm::vec3(1e20f, 0.0f, -5.0f), glm::vec3(1e20f), 1e20f);
+	Frustum far = box;
+	for(int i = 0; i < 6; i++) {
+		far.planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 3e30f);
+		for(int c = 0; c < 4; c++)
+			far.lanes[c][i] = far.planes[i][c];
+	}
+	compare(far, glm::vec3(0.0f), glm::vec3(0.0f), 2e30f);
+	check(simd::sphereFrustumOverlap(far, glm::vec3(0.0f), 2e30f) == FRUSTUM_INTERSECTING, "sphere crossing the padding");
+
+	if(failures == 0)
+		std::cout << "frustum: all checks passed" << std::endl;
+	return failures == 0 ? 0 : 1;
+}